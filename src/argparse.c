@@ -142,7 +142,7 @@ struct _gpgrt_argparse_internal_s
   const char *last;
   void *aliases;
   const void *cur_alias;
-  void *iio_list;
+  gpgrt_strset_t iio_set;
   estream_t conffp;
   char *confname;
   opttable_t *opts;            /* Malloced option table.  */
@@ -161,16 +161,6 @@ struct alias_def_s {
 };
 
 
-/* Object to store the names for the --ignore-invalid-option option.
-   This is a simple linked list.  */
-typedef struct iio_item_def_s *IIO_ITEM_DEF;
-struct iio_item_def_s
-{
-  IIO_ITEM_DEF next;
-  char name[1];      /* String with the long option name.  */
-};
-
-
 /* The almost always needed user handler for strusage.  */
 static const char *(*strusage_handler)( int ) = NULL;
 /* Optional handler to write strings.  See _gpgrt_set_usage_outfnc.  */
@@ -345,7 +335,7 @@ initialize (gpgrt_argparse_t *arg, gpgrt_opt_t *opts, estream_t fp)
       arg->internal->state = STATE_init;
       arg->internal->aliases = NULL;
       arg->internal->cur_alias = NULL;
-      arg->internal->iio_list = NULL;
+      arg->internal->iio_set = NULL;
       arg->internal->conffp = NULL;
       arg->internal->confname = NULL;
 #ifndef HAVE_W32_SYSTEM
@@ -585,12 +575,7 @@ store_alias( gpgrt_argparse_t *arg, char *name, char *value )
 static int
 ignore_invalid_option_p (gpgrt_argparse_t *arg, const char *keyword)
 {
-  IIO_ITEM_DEF item = arg->internal->iio_list;
-
-  for (; item; item = item->next)
-    if (!strcmp (item->name, keyword))
-      return 1;
-  return 0;
+  return _gpgrt_strset_contains (arg->internal->iio_set, keyword);
 }
 
 
@@ -601,7 +586,6 @@ ignore_invalid_option_p (gpgrt_argparse_t *arg, const char *keyword)
 static int
 ignore_invalid_option_add (gpgrt_argparse_t *arg, estream_t fp)
 {
-  IIO_ITEM_DEF item;
   int c;
   char name[100];
   int namelen = 0;
@@ -652,15 +636,11 @@ ignore_invalid_option_add (gpgrt_argparse_t *arg, estream_t fp)
 
         case addNAME:
           name[namelen] = 0;
-          if (!ignore_invalid_option_p (arg, name))
-            {
-              item = xtrymalloc (sizeof *item + namelen);
-              if (!item)
-                return 1;
-              strcpy (item->name, name);
-              item->next = (IIO_ITEM_DEF)arg->internal->iio_list;
-              arg->internal->iio_list = item;
-            }
+          if (!arg->internal->iio_set
+              && !(arg->internal->iio_set = _gpgrt_strset_new (0)))
+            return 1;
+          if (_gpgrt_strset_add (arg->internal->iio_set, name))
+            return 1;
           state = skipWS;
           goto again;
         }
@@ -673,14 +653,8 @@ ignore_invalid_option_add (gpgrt_argparse_t *arg, estream_t fp)
 static void
 ignore_invalid_option_clear (gpgrt_argparse_t *arg)
 {
-  IIO_ITEM_DEF item, tmpitem;
-
-  for (item = arg->internal->iio_list; item; item = tmpitem)
-    {
-      tmpitem = item->next;
-      xfree (item);
-    }
-  arg->internal->iio_list = NULL;
+  _gpgrt_strset_release (arg->internal->iio_set);
+  arg->internal->iio_set = NULL;
 }
 
 
@@ -1724,7 +1698,7 @@ _gpgrt_argparse (estream_t fp, gpgrt_argparse_t *arg, gpgrt_opt_t *opts_orig)
                 }
               else if (ignore_invalid_option_p (arg, keyword))
                 {
-                  /* This invalid option is already in the iio list.  */
+                  /* This invalid option is already in the iio set.  */
                   state = state == Akeyword_eol? Ainit : Acomment;
                   i = 0;
                 }
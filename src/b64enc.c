@@ -38,6 +38,10 @@
 #define B64ENC_NO_LINEFEEDS 16
 #define B64ENC_USE_PGPCRC   32
 
+/* The number of lines the encoder collects before writing them to
+ * the stream.  A line has 64 characters and a linefeed.  */
+#define B64ENC_LINES_PER_WRITE 16
+
 /* The base-64 character list */
 GPGRT_ATTR_NONSTRING
 static unsigned char const bintoasc[64] = ("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -143,6 +147,19 @@ static const uint32_t crc_table[256] = {
 };
 
 
+/* Encode the 3 bytes at SRC into the 4 characters at DST.  */
+static void
+encode_quad (char *dst, const unsigned char *src)
+{
+  uint32_t v = ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) | src[2];
+
+  dst[0] = bintoasc[(v >> 18) & 077];
+  dst[1] = bintoasc[(v >> 12) & 077];
+  dst[2] = bintoasc[(v >> 6) & 077];
+  dst[3] = bintoasc[v & 077];
+}
+
+
 /* Prepare for Base-64 writing to STREAM.  If TITLE is not NULL and
  * not an empty string, that string will be used as the title for the
  * armor lines, with TITLE being an empty string, we don't write the
@@ -195,6 +212,9 @@ _gpgrt_b64enc_write (gpgrt_b64state_t state, const void *buffer, size_t nbytes)
   unsigned char radbuf[4];
   int idx, quad_count;
   const unsigned char *p;
+  char outbuf[B64ENC_LINES_PER_WRITE * (64 + 1)];
+  size_t outlen;
+  int lf, i;
 
   if (state->lasterr)
     return state->lasterr;
@@ -238,32 +258,69 @@ _gpgrt_b64enc_write (gpgrt_b64state_t state, const void *buffer, size_t nbytes)
       state->crc = (crc & 0x00ffffff);
     }
 
-  for (p=buffer; nbytes; p++, nbytes--)
+  /* The output is collected in OUTBUF and written in one go.  Full
+   * lines are encoded by an unrolled loop.  */
+  lf = !(state->flags & B64ENC_NO_LINEFEEDS);
+  outlen = 0;
+  p = buffer;
+  if (idx)
     {
-      radbuf[idx++] = *p;
-      if (idx > 2)
+      /* Complete the group left over from the last call.  */
+      for (; idx < 3 && nbytes; p++, nbytes--)
+        radbuf[idx++] = *p;
+      if (idx == 3)
         {
-          char tmp[4];
-
-          tmp[0] = bintoasc[(*radbuf >> 2) & 077];
-          tmp[1] = bintoasc[(((*radbuf<<4)&060)|((radbuf[1] >> 4)&017))&077];
-          tmp[2] = bintoasc[(((radbuf[1]<<2)&074)|((radbuf[2]>>6)&03))&077];
-          tmp[3] = bintoasc[radbuf[2]&077];
-          for (idx=0; idx < 4; idx++)
-            _gpgrt_fputc (tmp[idx], state->stream);
+          encode_quad (outbuf, radbuf);
+          outlen = 4;
           idx = 0;
-          if (_gpgrt_ferror (state->stream))
-            goto write_error;
-
           if (++quad_count >= (64/4))
             {
               quad_count = 0;
-              if (!(state->flags & B64ENC_NO_LINEFEEDS)
-                  && _gpgrt_fputs ("\n", state->stream) == EOF)
-                goto write_error;
+              if (lf)
+                outbuf[outlen++] = '\n';
             }
         }
     }
+
+  while (nbytes >= 3)
+    {
+      if (outlen + 64 + 1 > sizeof outbuf)
+        {
+          if (_gpgrt_fwrite (outbuf, outlen, 1, state->stream) != 1)
+            goto write_error;
+          outlen = 0;
+        }
+
+      if (!quad_count && nbytes >= 48)
+        {
+          for (i=0; i < 64; i += 4, p += 3)
+            encode_quad (outbuf + outlen + i, p);
+          outlen += 64;
+          nbytes -= 48;
+          if (lf)
+            outbuf[outlen++] = '\n';
+          continue;
+        }
+
+      encode_quad (outbuf + outlen, p);
+      outlen += 4;
+      p += 3;
+      nbytes -= 3;
+      if (++quad_count >= (64/4))
+        {
+          quad_count = 0;
+          if (lf)
+            outbuf[outlen++] = '\n';
+        }
+    }
+
+  /* Keep the remaining bytes for the next call.  */
+  for (; nbytes; p++, nbytes--)
+    radbuf[idx++] = *p;
+
+  if (outlen && _gpgrt_fwrite (outbuf, outlen, 1, state->stream) != 1)
+    goto write_error;
+
   memcpy (state->radbuf, radbuf, idx);
   state->idx = idx;
   state->quad_count = quad_count;
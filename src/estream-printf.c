@@ -129,6 +129,14 @@
 /* We allocate this many new array argspec elements each time.  */
 #define ARGSPECS_BUMP_VALUE   10
 
+/* Size of the on-stack buffer used to collect output before passing
+   it to the output function.  */
+#define STAGING_BUFFER_SIZE  512
+
+/* Size of the on-stack buffer used by estream_asprintf before it
+   switches to a malloced buffer.  */
+#define DYNAMIC_BUFFER_STACK_SIZE  256
+
 /* Special values for the field width and the precision.  */
 #define NO_FIELD_VALUE   (-1)
 #define STAR_FIELD_VALUE (-2)
@@ -1538,16 +1546,14 @@ do_format (estream_printf_out_t outfnc, void *outfncarg,
 
 
 
-/* The versatile printf formatting routine.  It expects a callback
-   function OUTFNC and an opaque argument OUTFNCARG used for actual
-   output of the formatted stuff.  FORMAT is the format specification
-   and VAARGS a variable argumemt list matching the arguments of
-   FORMAT.  */
-int
-_gpgrt_estream_format (estream_printf_out_t outfnc,
-                       void *outfncarg,
-                       gpgrt_string_filter_t sf, void *sfvalue,
-                       const char *format, va_list vaargs)
+/* The core of the printf formatting routine.  This is the same as
+   _gpgrt_estream_format but passes all output unbuffered to OUTFNC;
+   it is used directly by the memory based output functions.  */
+static int
+do_estream_format (estream_printf_out_t outfnc,
+                   void *outfncarg,
+                   gpgrt_string_filter_t sf, void *sfvalue,
+                   const char *format, va_list vaargs)
 {
   /* Buffer to hold the argspecs and a pointer to it.*/
   struct argspec_s argspecs_buffer[DEFAULT_MAX_ARGSPECS];
@@ -1693,6 +1699,77 @@ _gpgrt_estream_format (estream_printf_out_t outfnc,
 }
 
 
+/* Object used to collect the output of do_format before it is passed
+   in larger chunks to the actual output function.  */
+struct staging_parm_s
+{
+  estream_printf_out_t outfnc;  /* The actual output function.  */
+  void *outfncarg;              /* Its opaque argument.  */
+  size_t used;                  /* Used size of BUFFER.  */
+  char buffer[STAGING_BUFFER_SIZE];
+};
+
+/* Pass the collected output to the actual output function.  */
+static int
+staging_flush (struct staging_parm_s *parm)
+{
+  int rc;
+
+  if (!parm->used)
+    return 0;
+  rc = parm->outfnc (parm->outfncarg, parm->buffer, parm->used);
+  parm->used = 0;
+  return rc;
+}
+
+/* Output function which collects the output in the staging buffer.
+   Data which does not fit into an empty buffer is directly passed to
+   the actual output function.  */
+static int
+staging_out (void *outfncarg, const char *buf, size_t buflen)
+{
+  struct staging_parm_s *parm = outfncarg;
+  int rc;
+
+  if (buflen > sizeof parm->buffer - parm->used)
+    {
+      rc = staging_flush (parm);
+      if (rc)
+        return rc;
+      if (buflen >= sizeof parm->buffer)
+        return parm->outfnc (parm->outfncarg, buf, buflen);
+    }
+  memcpy (parm->buffer + parm->used, buf, buflen);
+  parm->used += buflen;
+  return 0;
+}
+
+
+/* The versatile printf formatting routine.  It expects a callback
+   function OUTFNC and an opaque argument OUTFNCARG used for actual
+   output of the formatted stuff.  FORMAT is the format specification
+   and VAARGS a variable argumemt list matching the arguments of
+   FORMAT.  The output is collected in a stack buffer so that OUTFNC
+   is called only for larger chunks of data.  */
+int
+_gpgrt_estream_format (estream_printf_out_t outfnc,
+                       void *outfncarg,
+                       gpgrt_string_filter_t sf, void *sfvalue,
+                       const char *format, va_list vaargs)
+{
+  struct staging_parm_s parm;
+  int rc;
+
+  parm.outfnc = outfnc;
+  parm.outfncarg = outfncarg;
+  parm.used = 0;
+  rc = do_estream_format (staging_out, &parm, sf, sfvalue, format, vaargs);
+  if (!rc)
+    rc = staging_flush (&parm);
+  return rc;
+}
+
+
 
 
 /* A simple output handler utilizing stdio.  */
@@ -1797,8 +1874,8 @@ _gpgrt_estream_vsnprintf (char *buf, size_t bufsize,
   parm.count = 0;
   parm.used = 0;
   parm.buffer = bufsize?buf:NULL;
-  rc = _gpgrt_estream_format (fixed_buffer_out, &parm, NULL, NULL,
-                              format, arg_ptr);
+  rc = do_estream_format (fixed_buffer_out, &parm, NULL, NULL,
+                          format, arg_ptr);
   if (!rc)
     rc = fixed_buffer_out (&parm, "", 1); /* Print terminating Nul.  */
   if (rc == -1)
@@ -1828,13 +1905,16 @@ _gpgrt_estream_snprintf (char *buf, size_t bufsize, const char *format, ...)
 
 
 /* Communication object used between estream_asprintf and
-   dynamic_buffer_out.  */
+   dynamic_buffer_out.  The output is first collected in the stack
+   buffer STACKBUF; only if that overflows a malloced buffer is
+   used.  */
 struct dynamic_buffer_parm_s
 {
   int error_flag; /* Internal helper.  */
   size_t alloced; /* Allocated size of the buffer.  */
   size_t used;    /* Used size of the buffer.  */
-  char *buffer;   /* Malloced buffer.  */
+  char *buffer;   /* Malloced buffer or STACKBUF.  */
+  char stackbuf[DYNAMIC_BUFFER_STACK_SIZE];
 };
 
 /* A simple malloced buffer output handler.  */
@@ -1854,9 +1934,25 @@ dynamic_buffer_out (void *outfncarg, const char *buf, size_t buflen)
   if (parm->used + buflen >= parm->alloced)
     {
       char *p;
+      size_t newsize;
 
-      parm->alloced += buflen + 512;
-      p = my_printf_realloc (parm->buffer, parm->alloced);
+      /* Grow exponentially to keep the number of reallocs low.  */
+      newsize = parm->alloced * 2;
+      if (newsize < parm->used + buflen + 1)
+        newsize = parm->used + buflen + 512;
+      if (newsize < parm->alloced)
+        {
+          p = NULL;
+          _set_errno (ENOMEM);
+        }
+      else if (parm->buffer == parm->stackbuf)
+        {
+          p = my_printf_realloc (NULL, newsize);
+          if (p)
+            memcpy (p, parm->buffer, parm->used);
+        }
+      else
+        p = my_printf_realloc (parm->buffer, newsize);
       if (!p)
         {
           parm->error_flag = errno ? errno : ENOMEM;
@@ -1865,7 +1961,10 @@ dynamic_buffer_out (void *outfncarg, const char *buf, size_t buflen)
           memset (parm->buffer, 0, parm->used);
           return -1;
         }
+      if (parm->buffer == parm->stackbuf)
+        memset (parm->stackbuf, 0, parm->used);
       parm->buffer = p;
+      parm->alloced = newsize;
     }
   memcpy (parm->buffer + parm->used, buf, buflen);
   parm->used += buflen;
@@ -1876,7 +1975,9 @@ dynamic_buffer_out (void *outfncarg, const char *buf, size_t buflen)
 
 /* A replacement for vasprintf.  As with the BSD version of vasprintf
    -1 will be returned on error and NULL stored at BUFP.  On success
-   the number of bytes printed will be returned. */
+   the number of bytes printed will be returned.  Short results are
+   formatted into a stack buffer and then copied to an allocated
+   buffer of the exact size; thus they require only one malloc.  */
 int
 _gpgrt_estream_vasprintf (char **bufp, const char *format, va_list arg_ptr)
 {
@@ -1884,20 +1985,14 @@ _gpgrt_estream_vasprintf (char **bufp, const char *format, va_list arg_ptr)
   int rc;
 
   parm.error_flag = 0;
-  parm.alloced = 512;
+  parm.alloced = sizeof parm.stackbuf;
   parm.used = 0;
-  parm.buffer = my_printf_realloc (NULL, parm.alloced);
-  if (!parm.buffer)
-    {
-      *bufp = NULL;
-      return -1;
-    }
+  parm.buffer = parm.stackbuf;
 
-  rc = _gpgrt_estream_format (dynamic_buffer_out, &parm, NULL, NULL,
-                              format, arg_ptr);
+  rc = do_estream_format (dynamic_buffer_out, &parm, NULL, NULL,
+                          format, arg_ptr);
   if (!rc)
     rc = dynamic_buffer_out (&parm, "", 1); /* Print terminating Nul.  */
-  /* Fixme: Should we shrink the resulting buffer?  */
   if (rc != -1 && parm.error_flag)
     {
       rc = -1;
@@ -1906,13 +2001,25 @@ _gpgrt_estream_vasprintf (char **bufp, const char *format, va_list arg_ptr)
   if (rc == -1)
     {
       memset (parm.buffer, 0, parm.used);
-      if (parm.buffer)
+      if (parm.buffer != parm.stackbuf)
         my_printf_realloc (parm.buffer, 0);
       *bufp = NULL;
       return -1;
     }
   gpgrt_assert (parm.used);   /* We have at least the terminating Nul.  */
-  *bufp = parm.buffer;
+  if (parm.buffer == parm.stackbuf)
+    {
+      /* Everything fitted into the stack buffer; copy it to a buffer
+         of the exact size.  */
+      *bufp = my_printf_realloc (NULL, parm.used);
+      if (*bufp)
+        memcpy (*bufp, parm.stackbuf, parm.used);
+      memset (parm.stackbuf, 0, parm.used);
+      if (!*bufp)
+        return -1;
+    }
+  else
+    *bufp = parm.buffer;
   return parm.used - 1; /* Do not include that Nul. */
 }
 
@@ -985,6 +985,114 @@ static struct cookie_io_functions_s estream_functions_mem =
 
 
 
+/*
+ * Implementation of read-only memory based I/O on borrowed memory.
+ * The read function is only used in unbuffered mode; in buffered
+ * mode fill_stream lets the stream's buffer point directly into the
+ * memory.
+ */
+
+/* Cookie for read-only memory objects.  */
+typedef struct estream_cookie_memro
+{
+  const unsigned char *data;  /* The borrowed memory.  */
+  size_t data_len;            /* Length of DATA.  */
+  size_t offset;              /* Current offset in DATA.  */
+} *estream_cookie_memro_t;
+
+
+/*
+ * Read function for read-only memory objects.
+ */
+static gpgrt_ssize_t
+func_memro_read (void *cookie, void *buffer, size_t size)
+{
+  estream_cookie_memro_t memro_cookie = cookie;
+
+  if (!size)  /* Just the pending data check.  */
+    return (memro_cookie->data_len - memro_cookie->offset)? 0 : -1;
+
+  if (size > memro_cookie->data_len - memro_cookie->offset)
+    size = memro_cookie->data_len - memro_cookie->offset;
+  if (size)
+    {
+      memcpy (buffer, memro_cookie->data + memro_cookie->offset, size);
+      memro_cookie->offset += size;
+    }
+
+  return size;
+}
+
+
+/*
+ * Seek function for read-only memory objects.
+ */
+static int
+func_memro_seek (void *cookie, gpgrt_off_t *offset, int whence)
+{
+  estream_cookie_memro_t memro_cookie = cookie;
+  gpgrt_off_t pos_new;
+
+  switch (whence)
+    {
+    case SEEK_SET:
+      pos_new = *offset;
+      break;
+
+    case SEEK_CUR:
+      pos_new = memro_cookie->offset + *offset;
+      break;
+
+    case SEEK_END:
+      pos_new = memro_cookie->data_len + *offset;
+      break;
+
+    default:
+      _set_errno (EINVAL);
+      return -1;
+    }
+
+  if (pos_new < 0 || pos_new > (gpgrt_off_t)memro_cookie->data_len)
+    {
+      _set_errno (EINVAL);
+      return -1;
+    }
+
+  memro_cookie->offset = pos_new;
+  *offset = pos_new;
+
+  return 0;
+}
+
+
+/*
+ * The destroy function for read-only memory objects.  The memory
+ * itself is not owned by us.
+ */
+static int
+func_memro_destroy (void *cookie)
+{
+  mem_free (cookie);
+  return 0;
+}
+
+
+/*
+ * Access object for the read-only memory functions.
+ */
+static struct cookie_io_functions_s estream_functions_memro =
+  {
+    {
+      func_memro_read,
+      NULL,
+      func_memro_seek,
+      func_memro_destroy,
+    },
+    NULL,
+  };
+
+
+
 /*
  * Implementation of file descriptor based I/O.
  */
@@ -1134,6 +1242,62 @@ func_fd_seek (void *cookie, gpgrt_off_t *offset, int whence)
 }
 
 
+/*
+ * Positional read or write on the file descriptor FD.  CMD is either
+ * COOKIE_IOCTL_PREAD or COOKIE_IOCTL_PWRITE.  This does not change
+ * the file offset of the file descriptor.  This is used by fd and
+ * stdio based objects.
+ */
+static int
+fd_pio (int fd, int cmd, struct cookie_ioctl_pio_s *pio)
+{
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE)
+  gpgrt_ssize_t n = 0;
+  off_t offset;
+
+  pio->nbytes = 0;
+  offset = (off_t)pio->offset;
+  if (offset != pio->offset || offset < 0)
+    {
+      _set_errno (EINVAL);
+      return -1;
+    }
+  if (IS_INVALID_FD (fd))
+    {
+      _set_errno (ESPIPE);
+      return -1;
+    }
+
+  _gpgrt_pre_syscall ();
+  while (pio->nbytes < pio->length)
+    {
+      if (cmd == COOKIE_IOCTL_PREAD)
+        n = pread (fd, (char*)pio->buffer + pio->nbytes,
+                   pio->length - pio->nbytes, offset + pio->nbytes);
+      else
+        n = pwrite (fd, (char*)pio->buffer + pio->nbytes,
+                    pio->length - pio->nbytes, offset + pio->nbytes);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        break;
+      if (!n)
+        break;  /* EOF.  */
+      pio->nbytes += n;
+    }
+  _gpgrt_post_syscall ();
+
+  return (n == -1)? -1 : 0;
+#else /*!HAVE_PREAD*/
+  (void)fd;
+  (void)cmd;
+  (void)pio;
+  _set_errno (EOPNOTSUPP);
+  return -1;
+#endif /*!HAVE_PREAD*/
+}
+
+
 /*
  * The IOCTL function for fd objects.
  */
@@ -1168,6 +1332,8 @@ func_fd_ioctl (void *cookie, int cmd, void *ptr, size_t *len)
 #endif
         }
     }
+  else if (cmd == COOKIE_IOCTL_PREAD || cmd == COOKIE_IOCTL_PWRITE)
+    ret = fd_pio (fd_cookie->fd, cmd, ptr);
   else
     {
       _set_errno (EINVAL);
@@ -1851,6 +2017,48 @@ func_fp_seek (void *cookie, gpgrt_off_t *offset, int whence)
 }
 
 
+/*
+ * The IOCTL function for stdio based objects.  Positional I/O is
+ * done on the underlying file descriptor.  The stdio buffer is
+ * flushed before a positional write; this also drops data read ahead
+ * by stdio which might be overwritten.
+ */
+static int
+func_fp_ioctl (void *cookie, int cmd, void *ptr, size_t *len)
+{
+  estream_cookie_fp_t fp_cookie = cookie;
+  int ret;
+
+  (void)len;
+
+  if (cmd == COOKIE_IOCTL_PREAD || cmd == COOKIE_IOCTL_PWRITE)
+    {
+      if (!fp_cookie->fp)
+        {
+          _set_errno (ESPIPE);
+          ret = -1;
+        }
+      else
+        {
+          if (cmd == COOKIE_IOCTL_PWRITE)
+            {
+              _gpgrt_pre_syscall ();
+              fflush (fp_cookie->fp);
+              _gpgrt_post_syscall ();
+            }
+          ret = fd_pio (fileno (fp_cookie->fp), cmd, ptr);
+        }
+    }
+  else
+    {
+      _set_errno (EOPNOTSUPP);
+      ret = -1;
+    }
+
+  return ret;
+}
+
+
 /*
  * Destroy function for stdio based objects.
  */
@@ -1891,7 +2099,7 @@ static struct cookie_io_functions_s estream_functions_fp =
       func_fp_seek,
       func_fp_destroy,
     },
-    NULL,
+    func_fp_ioctl,
   };
 
 
@@ -2347,6 +2555,17 @@ fill_stream (estream_t stream)
     }
   else if (!stream->buffer_size)
     err = 0;
+  else if (stream->intern->kind == BACKEND_MEM_RO)
+    {
+      estream_cookie_memro_t memro_cookie = stream->intern->cookie;
+
+      /* Instead of copying let the buffer point into the memory.  */
+      stream->buffer = (unsigned char *)(memro_cookie->data
+                                         + memro_cookie->offset);
+      bytes_read = memro_cookie->data_len - memro_cookie->offset;
+      memro_cookie->offset = memro_cookie->data_len;
+      err = 0;
+    }
   else
     {
       gpgrt_cookie_read_function_t func_read = stream->intern->func_read;
@@ -2515,6 +2734,7 @@ init_stream_obj (estream_t stream,
   stream->intern->printable_fname_inuse = 0;
   stream->intern->samethread = !! (xmode & X_SAMETHREAD);
   stream->intern->wipe = !! (xmode & X_WIPE);
+  stream->intern->offset_known = 0;
   stream->intern->onclose = NULL;
 
   stream->data_len = 0;
@@ -2561,6 +2781,14 @@ deinit_stream_obj (estream_t stream)
         err = tmp_err;
     }
 
+  if (stream->intern->kind == BACKEND_MEM_RO)
+    {
+      /* Do not keep a pointer into the borrowed memory.  */
+      stream->buffer = stream->intern->buffer;
+      stream->data_len = 0;
+      stream->data_offset = 0;
+    }
+
   mem_free (stream->intern->printable_fname);
   stream->intern->printable_fname = NULL;
   stream->intern->printable_fname_inuse = 0;
@@ -3090,6 +3318,7 @@ es_seek (estream_t _GPGRT__RESTRICT stream, gpgrt_off_t offset, int whence,
 
   stream->intern->indicators.eof = 0;
   stream->intern->offset = off;
+  stream->intern->offset_known = 1;
 
  out:
 
@@ -3104,6 +3333,40 @@ es_seek (estream_t _GPGRT__RESTRICT stream, gpgrt_off_t offset, int whence,
 }
 
 
+/*
+ * Try to seek in STREAM by only moving within the data currently
+ * held in the read buffer.  Returns true on success; false is
+ * returned if es_seek needs to be used.  The start offset of the
+ * buffer is only known for sure after a real seek; thus SEEK_SET is
+ * only handled after that.  This must not be used if the cookie's
+ * offset needs to be synchronized with the stream's offset.
+ */
+static int
+es_seek_in_buffer (estream_t stream, gpgrt_off_t offset, int whence)
+{
+  gpgrt_off_t pos;
+
+  if (stream->flags.writing || stream->unread_data_len
+      || !stream->intern->func_seek)
+    return 0;
+
+  if (whence == SEEK_CUR)
+    pos = stream->intern->offset + stream->data_offset + offset;
+  else if (whence == SEEK_SET && stream->intern->offset_known)
+    pos = offset;
+  else
+    return 0;
+
+  if (pos < stream->intern->offset
+      || pos > stream->intern->offset + (gpgrt_off_t)stream->data_len)
+    return 0;
+
+  stream->data_offset = pos - stream->intern->offset;
+  stream->intern->indicators.eof = 0;
+  return 1;
+}
+
+
 /*
  * Write BYTES_TO_WRITE bytes from BUFFER into STREAM in
  * unbuffered-mode, storing the amount of bytes written at
@@ -3250,6 +3513,15 @@ es_writen (estream_t _GPGRT__RESTRICT stream,
   data_written = 0;
   err = 0;
 
+  if (stream->intern->kind == BACKEND_MEM_RO)
+    {
+      /* The buffer may point into the read-only memory.  */
+      _set_errno (EBADF);
+      stream->intern->indicators.err = 1;
+      err = -1;
+      goto out;
+    }
+
   if (!stream->flags.writing)
     {
       /* Switching to writing mode -> discard input data and seek to
@@ -3532,6 +3804,16 @@ es_set_buffering (estream_t _GPGRT__RESTRICT stream,
 
   stream->intern->indicators.eof = 0;
 
+  if (stream->intern->kind == BACKEND_MEM_RO)
+    {
+      /* The buffer points into the memory; we only switch between
+       * buffered and unbuffered reading.  */
+      stream->buffer_size = (mode == _IONBF)? 0 : BUFFER_BLOCK_SIZE;
+      stream->intern->strategy = mode;
+      err = 0;
+      goto out;
+    }
+
   /* Free old buffer in case that was allocated by this function.  */
   if (stream->intern->deallocate_buffer)
     {
@@ -3782,6 +4064,47 @@ _gpgrt_fopenmem_init (size_t memlimit, const char *_GPGRT__RESTRICT mode,
 
 
 
+/* Create a read-only stream for the DATALEN bytes at DATA.  The memory
+ * is neither copied nor modified nor released; it must stay valid
+ * until the stream has been closed.  */
+estream_t
+_gpgrt_fopenmem_ro (const void *data, size_t datalen)
+{
+  estream_cookie_memro_t cookie;
+  unsigned int modeflags, xmode;
+  estream_t stream = NULL;
+  es_syshd_t syshd;
+
+  if (!data && datalen)
+    {
+      _set_errno (EINVAL);
+      return NULL;
+    }
+  if (parse_mode ("r", &modeflags, &xmode, NULL))
+    return NULL;
+
+  cookie = mem_alloc (sizeof *cookie);
+  if (!cookie)
+    return NULL;
+  cookie->data = data;
+  cookie->data_len = datalen;
+  cookie->offset = 0;
+
+  memset (&syshd, 0, sizeof syshd);
+  if (create_stream (&stream, cookie, &syshd, BACKEND_MEM_RO,
+                     estream_functions_memro, modeflags, xmode, 0))
+    {
+      func_memro_destroy (cookie);
+      return NULL;
+    }
+
+  /* The start of the memory is the file offset 0.  */
+  stream->intern->offset_known = 1;
+  return stream;
+}
+
+
+
 estream_t
 _gpgrt_fopencookie (void *_GPGRT__RESTRICT cookie,
                     const char *_GPGRT__RESTRICT mode,
@@ -4553,6 +4876,25 @@ do_fflush (estream_t stream)
 }
 
 
+/* Flush STREAM which must be locked by the caller.  */
+int
+_gpgrt_fflush_unlocked (estream_t stream)
+{
+  return do_fflush (stream);
+}
+
+
+/* Re-initialize the lock of STREAM.  This is only to be used in a
+ * child process right after fork to recover from a lock which was
+ * held by another thread of the parent.  The buffer of STREAM may
+ * then contain partial data written by that thread.  */
+void
+_gpgrt_freset_lock (estream_t stream)
+{
+  init_stream_lock (stream);
+}
+
+
 /* IN_ATEXIT is set when this function is called by an atexit handler.  */
 int
 _gpgrt_fflush (estream_t stream, int in_atexit)
@@ -4607,7 +4949,10 @@ _gpgrt_fseek (estream_t stream, long int offset, int whence)
   int err;
 
   lock_stream (stream);
-  err = es_seek (stream, offset, whence, NULL);
+  if (es_seek_in_buffer (stream, offset, whence))
+    err = 0;
+  else
+    err = es_seek (stream, offset, whence, NULL);
   unlock_stream (stream);
 
   return err;
@@ -4620,7 +4965,10 @@ _gpgrt_fseeko (estream_t stream, gpgrt_off_t offset, int whence)
   int err;
 
   lock_stream (stream);
-  err = es_seek (stream, offset, whence, NULL);
+  if (es_seek_in_buffer (stream, offset, whence))
+    err = 0;
+  else
+    err = es_seek (stream, offset, whence, NULL);
   unlock_stream (stream);
 
   return err;
@@ -4792,6 +5140,121 @@ _gpgrt_write (estream_t _GPGRT__RESTRICT stream,
 }
 
 
+/* Same as _gpgrt_write but the caller must hold the lock on
+ * STREAM.  */
+int
+_gpgrt_write_unlocked (estream_t _GPGRT__RESTRICT stream,
+                       const void *_GPGRT__RESTRICT buffer,
+                       size_t bytes_to_write,
+                       size_t *_GPGRT__RESTRICT bytes_written)
+{
+  if (!bytes_to_write)
+    return 0;
+  return es_writen (stream, buffer, bytes_to_write, bytes_written);
+}
+
+
+/* Drop the read buffer of STREAM if it may hold data of the LENGTH
+ * bytes at file offset OFFSET which have been overwritten by a
+ * positional write.  This is the same as a seek to the current
+ * position.  The caller must hold the lock on STREAM.  */
+static void
+pio_drop_read_buffer (estream_t stream, gpgrt_off_t offset, size_t length)
+{
+  if (stream->flags.writing || !stream->data_len)
+    return;
+  if (stream->intern->offset_known
+      && (offset >= stream->intern->offset + (gpgrt_off_t)stream->data_len
+          || offset + (gpgrt_off_t)length <= stream->intern->offset))
+    return;  /* No overlap.  */
+
+  es_seek (stream, 0, SEEK_CUR, NULL);
+}
+
+
+/* Common code for _gpgrt_pread and _gpgrt_pwrite.  For reading the
+ * stream is not locked because neither its buffer nor its file
+ * offset is used; thus several threads may read from the same stream
+ * without blocking each other.  For writing the stream is locked to
+ * drop read buffered data which has been overwritten.  */
+static int
+do_pio (estream_t stream, int cmd, void *buffer, size_t length,
+        gpgrt_off_t offset, size_t *r_nbytes)
+{
+  cookie_ioctl_function_t func_ioctl;
+  struct cookie_ioctl_pio_s pio;
+  int ret;
+
+  func_ioctl = stream->intern->func_ioctl;
+  if (!func_ioctl)
+    {
+      _set_errno (EOPNOTSUPP);
+      ret = -1;
+      pio.nbytes = 0;
+    }
+  else if (!length)
+    {
+      ret = 0;
+      pio.nbytes = 0;
+    }
+  else
+    {
+      pio.buffer = buffer;
+      pio.length = length;
+      pio.offset = offset;
+      pio.nbytes = 0;
+      if (cmd == COOKIE_IOCTL_PREAD)
+        ret = func_ioctl (stream->intern->cookie, cmd, &pio, NULL);
+      else
+        {
+          lock_stream (stream);
+          ret = func_ioctl (stream->intern->cookie, cmd, &pio, NULL);
+          if (pio.nbytes)
+            pio_drop_read_buffer (stream, offset, pio.nbytes);
+          unlock_stream (stream);
+        }
+    }
+
+  if (r_nbytes)
+    *r_nbytes = pio.nbytes;
+  return ret;
+}
+
+
+/* Read up to BYTES_TO_READ bytes from STREAM at file offset OFFSET
+ * into BUFFER.  The stream's buffer and its current file offset are
+ * not used and not changed; data written to the stream but not yet
+ * flushed is thus not seen.  Returns 0 on success and stores the
+ * number of bytes read at BYTES_READ, which is less than
+ * BYTES_TO_READ only at end of file.  Only file descriptor and stdio
+ * based streams are supported.  */
+int
+_gpgrt_pread (estream_t _GPGRT__RESTRICT stream,
+              void *_GPGRT__RESTRICT buffer, size_t bytes_to_read,
+              gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_read)
+{
+  return do_pio (stream, COOKIE_IOCTL_PREAD, buffer, bytes_to_read,
+                 offset, bytes_read);
+}
+
+
+/* Write BYTES_TO_WRITE bytes from BUFFER to STREAM at file offset
+ * OFFSET.  As with _gpgrt_pread the stream's buffer and file offset
+ * are not used.  However, buffered read data which may have been
+ * overwritten is dropped so that a later read returns the new data;
+ * data written to the stream but not yet flushed is not merged.
+ * Returns 0 on success and stores the number of bytes written at
+ * BYTES_WRITTEN.  */
+int
+_gpgrt_pwrite (estream_t _GPGRT__RESTRICT stream,
+               const void *_GPGRT__RESTRICT buffer, size_t bytes_to_write,
+               gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_written)
+{
+  return do_pio (stream, COOKIE_IOCTL_PWRITE, (void *)buffer, bytes_to_write,
+                 offset, bytes_written);
+}
+
+
 size_t
 _gpgrt_fread (void *_GPGRT__RESTRICT ptr, size_t size, size_t nitems,
               estream_t _GPGRT__RESTRICT stream)
@@ -222,6 +222,18 @@ typedef int (*cookie_ioctl_function_t) (void *cookie, int cmd,
 #define COOKIE_IOCTL_SNATCH_BUFFER 1
 #define COOKIE_IOCTL_NONBLOCK      2
 #define COOKIE_IOCTL_TRUNCATE      3
+#define COOKIE_IOCTL_PREAD         4
+#define COOKIE_IOCTL_PWRITE        5
+
+/* The object passed to the COOKIE_IOCTL_PREAD and COOKIE_IOCTL_PWRITE
+ * commands.  */
+struct cookie_ioctl_pio_s
+{
+  void *buffer;        /* The buffer to read into or to write from.  */
+  size_t length;       /* Number of bytes to transfer.  */
+  gpgrt_off_t offset;  /* The file offset for the transfer.  */
+  size_t nbytes;       /* Returns the number of bytes transferred.  */
+};
 
 /* An internal variant of gpgrt_cookie_close_function_t with a slot
  * for the ioctl function.  */
@@ -239,7 +251,8 @@ typedef enum
     BACKEND_W32,
     BACKEND_FP,
     BACKEND_USER,
-    BACKEND_W32_POLLABLE
+    BACKEND_W32_POLLABLE,
+    BACKEND_MEM_RO
   } gpgrt_stream_backend_kind_t;
 
 
@@ -304,6 +317,7 @@ struct _gpgrt_stream_internal
   unsigned int printable_fname_inuse: 1;  /* es_fname_get has been used.  */
   unsigned int samethread: 1;    /* The "samethread" mode keyword.  */
   unsigned int wipe: 1;          /* The "wipe" mode keyword.  */
+  unsigned int offset_known: 1;  /* OFFSET is the real file offset.  */
   size_t print_ntotal;           /* Bytes written from in print_writer. */
   notify_list_t onclose;         /* On close notify function list.  */
 };
@@ -330,6 +344,7 @@ gpgrt_stream_t _gpgrt_fopenmem (size_t memlimit,
 gpgrt_stream_t _gpgrt_fopenmem_init (size_t memlimit,
                                      const char *_GPGRT__RESTRICT mode,
                                      const void *data, size_t datalen);
+gpgrt_stream_t _gpgrt_fopenmem_ro (const void *data, size_t datalen);
 gpgrt_stream_t _gpgrt_fdopen    (int filedes, const char *mode);
 gpgrt_stream_t _gpgrt_fdopen_nc (int filedes, const char *mode);
 gpgrt_stream_t _gpgrt_sysopen    (gpgrt_syshd_t *syshd, const char *mode);
@@ -378,6 +393,8 @@ int _gpgrt__pending (gpgrt_stream_t stream);
 int _gpgrt__pending_unlocked (gpgrt_stream_t stream);
 
 int _gpgrt_fflush (gpgrt_stream_t stream, int in_atexit);
+int _gpgrt_fflush_unlocked (gpgrt_stream_t stream);
+void _gpgrt_freset_lock (gpgrt_stream_t stream);
 int _gpgrt_fseek (gpgrt_stream_t stream, long int offset, int whence);
 int _gpgrt_fseeko (gpgrt_stream_t stream, gpgrt_off_t offset, int whence);
 long int _gpgrt_ftell (gpgrt_stream_t stream);
@@ -415,6 +432,16 @@ int _gpgrt_read (gpgrt_stream_t _GPGRT__RESTRICT stream,
 int _gpgrt_write (gpgrt_stream_t _GPGRT__RESTRICT stream,
                   const void *_GPGRT__RESTRICT buffer, size_t bytes_to_write,
                   size_t *_GPGRT__RESTRICT bytes_written);
+int _gpgrt_write_unlocked (gpgrt_stream_t _GPGRT__RESTRICT stream,
+                           const void *_GPGRT__RESTRICT buffer,
+                           size_t bytes_to_write,
+                           size_t *_GPGRT__RESTRICT bytes_written);
+int _gpgrt_pread (gpgrt_stream_t _GPGRT__RESTRICT stream,
+                  void *_GPGRT__RESTRICT buffer, size_t bytes_to_read,
+                  gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_read);
+int _gpgrt_pwrite (gpgrt_stream_t _GPGRT__RESTRICT stream,
+                   const void *_GPGRT__RESTRICT buffer, size_t bytes_to_write,
+                   gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_written);
 int _gpgrt_write_sanitized (gpgrt_stream_t _GPGRT__RESTRICT stream,
                             const void *_GPGRT__RESTRICT buffer, size_t length,
                             const char *delimiters,
@@ -540,6 +567,13 @@ void _gpgrt_log_set_socket_dir_cb (const char *(*fnc)(void));
 void _gpgrt_log_set_pid_suffix_cb (int (*cb)(unsigned long *r_value));
 void _gpgrt_log_set_prefix (const char *text, unsigned int flags);
 void _gpgrt_add_post_log_func (void (*f)(int));
+gpg_err_code_t _gpgrt_log_set_async (unsigned int flags,
+                                     unsigned int nrecords);
+unsigned int _gpgrt_log_set_level (unsigned int mask);
+int  _gpgrt_log_level_p (int level);
+void _gpgrt_log_set_rotate (size_t maxsize, unsigned int maxage,
+                            unsigned int nkeep);
+void _gpgrt_log_set_ratelimit (unsigned int burst, unsigned int interval);
 const char *_gpgrt_log_get_prefix (unsigned int *flags);
 int  _gpgrt_log_test_fd (int fd);
 int  _gpgrt_log_get_fd (void);
@@ -557,6 +591,7 @@ void _gpgrt_log_fatal (const char *fmt, ...)  GPGRT_ATTR_NR_PRINTF(1,2);
 void _gpgrt_log_error (const char *fmt, ...)  GPGRT_ATTR_PRINTF(1,2);
 void _gpgrt_log_info (const char *fmt, ...)   GPGRT_ATTR_PRINTF(1,2);
 void _gpgrt_log_debug (const char *fmt, ...)  GPGRT_ATTR_PRINTF(1,2);
+void _gpgrt_log_debug_nolimit (const char *fmt, ...) GPGRT_ATTR_PRINTF(1,2);
 void _gpgrt_log_debug_string (const char *string, const char *fmt,
                               ...) GPGRT_ATTR_PRINTF(2,3);
 
@@ -596,6 +631,14 @@ int _gpgrt_logv_internal (int level, int ignore_arg_ptr,
                           const char *prefmt, const char *fmt,
                           va_list arg_ptr);
 
+
+/*
+ * Local prototypes for the timers.
+ */
+void _gpgrt_timer_start (const char *name);
+void _gpgrt_timer_stop (const char *name);
+void _gpgrt_timer_dump (int reset);
+
 
 /*
  * Local prototypes for the spawn functions.
@@ -769,6 +812,9 @@ int _gpgrt_cmp_version (const char *a, const char *b, int level);
 void _gpgrt_strlist_free (gpgrt_strlist_t sl);
 gpgrt_strlist_t _gpgrt_strlist_add (gpgrt_strlist_t *list,
                                     const char *string, unsigned int flags);
+gpgrt_strlist_t _gpgrt_strlist_append (gpgrt_strlist_t *list,
+                                       gpgrt_strlist_t *tailp,
+                                       const char *string, unsigned int flags);
 gpgrt_strlist_t _gpgrt_strlist_tokenize (gpgrt_strlist_t *list,
                                          const char *string, const char *delim,
                                          unsigned int flags);
@@ -780,6 +826,15 @@ gpgrt_strlist_t _gpgrt_strlist_last (gpgrt_strlist_t node);
 char *_gpgrt_strlist_pop (gpgrt_strlist_t *list);
 gpgrt_strlist_t _gpgrt_strlist_find (gpgrt_strlist_t haystack,
                                      const char *needle);
+gpgrt_strset_t _gpgrt_strset_new (unsigned int flags);
+void _gpgrt_strset_release (gpgrt_strset_t set);
+gpg_err_code_t _gpgrt_strset_add (gpgrt_strset_t set, const char *string);
+int _gpgrt_strset_contains (gpgrt_strset_t set, const char *string);
+unsigned int _gpgrt_strset_count (gpgrt_strset_t set);
+gpg_err_code_t _gpgrt_strset_add_strlist (gpgrt_strset_t set,
+                                          gpgrt_strlist_t list);
+gpg_err_code_t _gpgrt_strset_to_strlist (gpgrt_strset_t set,
+                                         gpgrt_strlist_t *r_list);
 
 /*
  * name-value.c
@@ -797,7 +852,20 @@ void _gpgrt_nvc_delete (gpgrt_nvc_t cont, gpgrt_nve_t entry, const char *name);
 gpgrt_nve_t _gpgrt_nvc_lookup (gpgrt_nvc_t cont, const char *name);
 gpg_err_code_t _gpgrt_nvc_parse (gpgrt_nvc_t *result, int *errlinep,
                                  estream_t stream, unsigned int flags);
+gpg_err_code_t _gpgrt_nvc_parse_mem (gpgrt_nvc_t *result, int *errlinep,
+                                     const void *buffer, size_t length,
+                                     unsigned int flags);
+gpg_err_code_t _gpgrt_nvc_parse_files (gpgrt_nvc_t *results,
+                                       gpg_err_code_t *errors,
+                                       const char * const *fnames,
+                                       int nfiles, unsigned int flags,
+                                       int nthreads);
 gpg_err_code_t _gpgrt_nvc_write (gpgrt_nvc_t cont, estream_t stream);
+gpg_err_code_t _gpgrt_nvc_update_file (gpgrt_nvc_t cont, const char *fname);
+gpg_err_code_t _gpgrt_nvc_save_binary (gpgrt_nvc_t cont, estream_t stream);
+gpg_err_code_t _gpgrt_nvc_load_binary (gpgrt_nvc_t *result,
+                                       const void *buffer, size_t length,
+                                       unsigned int flags);
 gpgrt_nve_t _gpgrt_nve_next (gpgrt_nve_t entry, const char *name);
 const char *_gpgrt_nve_name (gpgrt_nve_t entry);
 const char *_gpgrt_nve_value (gpgrt_nve_t entry);
@@ -46,7 +46,19 @@
 #endif /*!HAVE_W32_SYSTEM*/
 #include <unistd.h>
 #include <fcntl.h>
+#if !defined(HAVE_W32_SYSTEM) && defined(HAVE_POLL_H)
+# include <poll.h>
+#endif
 /* #include <execinfo.h> */
+#ifdef HAVE_GETTIMEOFDAY
+# include <sys/time.h>
+#endif
+#if USE_POSIX_THREADS && !USE_POSIX_THREADS_WEAK
+# include <pthread.h>
+# define USE_ASYNC_LOG 1
+# define USE_ATFORK 1
+# define USE_THREAD_KEYS 1
+#endif
 
 #define _GPGRT_NEED_AFLOCAL 1
 #include "gpgrt-int.h"
@@ -77,6 +89,10 @@
 #define INADDR_NONE  ((unsigned long)(-1))
 #endif /*INADDR_NONE*/
 
+#ifndef O_BINARY
+# define O_BINARY 0
+#endif
+
 #ifdef HAVE_W32_SYSTEM
 #define sock_close(a)  closesocket(a)
 #else
@@ -85,11 +101,14 @@
 
 
 static estream_t logstream;
+static int flush_logstream;  /* LOGSTREAM is not ours; flush records.  */
 static int log_socket = -1;
 static char prefix_buffer[80];
 static int with_time;
+static int time_precision;  /* 0 = seconds, 3 = msec, 6 = usec.  */
 static int with_prefix;
 static int with_pid;
+static int with_json;
 #ifdef HAVE_W32_SYSTEM
 static int no_registry;
 #endif
@@ -101,6 +120,116 @@ static int force_prefixes;
 static int missing_lf;
 static int errorcount;
 
+/* Limits for the rotation of log files; see _gpgrt_log_set_rotate.  */
+static size_t rotate_maxsize;
+static unsigned int rotate_maxage;
+static unsigned int rotate_nkeep;
+
+/* The levels to log; bit N is set for level N.  See
+ * _gpgrt_log_set_level.  */
+static volatile unsigned int log_level_mask = ~0u;
+
+/* Set if the last record of the thread has been suppressed; its
+ * continuations are then suppressed as well.  This is kept per
+ * thread so that a suppressed record does not hide the continuations
+ * of another thread; the global variable is only used without thread
+ * specific data.  See get_suppressed_cont.  */
+static volatile int suppressed_cont;
+#ifdef USE_THREAD_KEYS
+static pthread_once_t suppressed_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t suppressed_key;
+static int suppressed_key_okay;
+#endif
+
+/* Lock to protect the caches used by print_prefix.  */
+GPGRT_LOCK_DEFINE (prefix_cache_lock);
+
+/* The rate limit for repeated messages; see _gpgrt_log_set_ratelimit.
+ * The slots are indexed by a hash of the format string's address and
+ * the level.  They are modified under RATELIMIT_LOCK except for the
+ * COUNT of a message within its burst; see ratelimit_check.  */
+#define RATELIMIT_SLOTS 64
+static volatile unsigned int ratelimit_burst;
+static unsigned int ratelimit_interval;
+GPGRT_LOCK_DEFINE (ratelimit_lock);
+static struct
+{
+  const char *fmt;
+  int level;
+  time_t start;             /* Start of the current interval.  */
+  unsigned int count;       /* Messages logged in this interval.  */
+  unsigned int suppressed;  /* Messages suppressed in this interval.  */
+} ratelimit_slots[RATELIMIT_SLOTS];
+
+/* The rendered local time of the second TIME_CACHE_SECOND.  */
+static time_t time_cache_second = (time_t)(-1);
+static char time_cache_string[20];  /* "YYYY-MM-DD HH:MM:SS" */
+
+/* The rendered "[PID" of the current process or an empty string.  */
+static char pid_cache_string[24];
+
+/* The size of the stack based buffer used to assemble a log record.
+ * Only longer records require a heap allocation.  */
+#define RECORD_STACK_SIZE 1024
+
+/* An object to assemble a log record before it is written out.  The
+ * first byte of BUFFER is reserved for a LF which terminates a
+ * previous record; this allows to write each record using a single
+ * write call.  */
+struct logrec_s
+{
+  char *buffer;     /* Points to STACKBUF or to a malloced buffer.  */
+  size_t size;      /* Allocated size of BUFFER.  */
+  size_t len;       /* Used length of BUFFER including the LF slot.  */
+  int error;        /* Out of core - the record has been truncated.  */
+  int missing_lf;   /* The record does not end in a LF.  */
+  char stackbuf[RECORD_STACK_SIZE];
+};
+
+
+#ifdef USE_ASYNC_LOG
+/* A record queued for the asynchronous writer.  */
+struct async_rec_s
+{
+  int level;
+  int missing_lf;
+  size_t len;
+  char data[1];
+};
+
+/* The state of the asynchronous log writer.  The queue is a ring
+ * buffer of NSLOTS record pointers.  */
+struct async_log_s
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t notempty; /* Signaled when a record has been queued.  */
+  pthread_cond_t notfull;  /* Signaled when the writer took a record.  */
+  pthread_cond_t idle;     /* Signaled when the queue has been drained.  */
+  pthread_t thread;
+  unsigned int block:1;    /* Block instead of dropping records.  */
+  unsigned int stop:1;     /* Ask the writer thread to terminate.  */
+  unsigned int busy:1;     /* The writer is currently writing.  */
+  unsigned int nslots;     /* Number of slots in RING.  */
+  unsigned int head;       /* Index of the oldest queued record.  */
+  unsigned int count;      /* Number of queued records.  */
+  unsigned long dropped;   /* Number of dropped but not reported records.  */
+  struct async_rec_s *ring[1];
+};
+
+/* The maximum number of records which may be queued.  */
+#define ASYNC_LOG_MAX_RECORDS (1024*1024)
+
+/* If not NULL log records are written by a background thread.  */
+static struct async_log_s *async_log;
+
+static void async_drain (void);
+#endif /*USE_ASYNC_LOG*/
+
+#ifdef USE_ATFORK
+static void register_atfork (void);
+#endif
+static void ratelimit_flush (void);
+
 /* The list of registered functions to be called after logging.  */
 struct post_log_func_item_s;
 typedef struct post_log_func_item_s *post_log_func_item_t;
@@ -144,6 +273,14 @@ _gpgrt_inc_errorcount (void)
 }
 
 
+/* The maximum number of bytes kept while the log socket is not
+ * connected or would block.  */
+#define LOG_RETAIN_SIZE (64*1024)
+
+/* The maximum delay in seconds between attempts to connect the log
+ * socket.  */
+#define LOG_BACKOFF_MAX 64
+
 /* The following 3 functions are used by _gpgrt_fopencookie to write logs
    to a socket.  */
 struct fun_cookie_s
@@ -152,30 +289,28 @@ struct fun_cookie_s
   int quiet;
   int want_socket;
   int is_socket;
+  int connecting;        /* A non-blocking connect is in progress.  */
+  time_t connect_end;    /* Give up a pending connect at this time.  */
+  unsigned int backoff;  /* Current delay between connect attempts.  */
+  time_t next_connect;   /* Don't try to connect before this time.  */
+  char *retbuf;          /* Data not yet sent; LOG_RETAIN_SIZE bytes.  */
+  size_t retlen;         /* Used length of RETBUF.  */
+  int head_partial;      /* RETBUF starts in the middle of a record.  */
   char name[1];
 };
 
 
 /* Write NBYTES of BUFFER to file descriptor FD. */
 static int
-writen (int fd, const void *buffer, size_t nbytes, int is_socket)
+writen (int fd, const void *buffer, size_t nbytes)
 {
   const char *buf = buffer;
   size_t nleft = nbytes;
   int nwritten;
-#ifndef HAVE_W32_SYSTEM
-  (void)is_socket; /* Not required.  */
-#endif
 
   while (nleft > 0)
     {
-#ifdef HAVE_W32_SYSTEM
-      if (is_socket)
-        nwritten = send (fd, buf, nleft, 0);
-      else
-#endif
-        nwritten = write (fd, buf, nleft);
-
+      nwritten = write (fd, buf, nleft);
       if (nwritten < 0 && errno == EINTR)
         continue;
       if (nwritten < 0)
@@ -188,6 +323,197 @@ writen (int fd, const void *buffer, size_t nbytes, int is_socket)
 }
 
 
+/* Send up to NBYTES of BUFFER to the log socket FD.  Returns the
+ * number of bytes sent, which is less than NBYTES if the socket
+ * would block, or -1 on error.  */
+static gpgrt_ssize_t
+sock_send (int fd, const void *buffer, size_t nbytes)
+{
+  const char *buf = buffer;
+  size_t nleft = nbytes;
+  gpgrt_ssize_t n;
+
+  while (nleft > 0)
+    {
+#ifdef HAVE_W32_SYSTEM
+      n = send (fd, buf, nleft, 0);
+#elif defined(MSG_NOSIGNAL)
+      n = send (fd, buf, nleft, MSG_NOSIGNAL);
+#else
+      n = write (fd, buf, nleft);
+#endif
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      if (n < 0)
+        return -1;
+      nleft -= n;
+      buf += n;
+    }
+
+  return nbytes - nleft;
+}
+
+
+/* Remove N bytes at offset OFF from the retention buffer of COOKIE.  */
+static void
+retain_remove (struct fun_cookie_s *cookie, size_t off, size_t n)
+{
+  if (off > cookie->retlen)
+    off = cookie->retlen;
+  if (n < cookie->retlen - off)
+    memmove (cookie->retbuf + off, cookie->retbuf + off + n,
+             cookie->retlen - off - n);
+  else
+    n = cookie->retlen - off;
+  cookie->retlen -= n;
+}
+
+
+/* Keep (BUFFER,SIZE) to be sent after a reconnect.  If the retention
+ * buffer is full the oldest lines are dropped.  If the start of the
+ * first line has already been sent, that line is kept so that the
+ * record is completed and the lines after it are dropped.  */
+static void
+retain_data (struct fun_cookie_s *cookie, const void *buffer, size_t size)
+{
+  const char *p;
+  size_t need, start, end;
+
+  if (!size || size > LOG_RETAIN_SIZE)
+    return;  /* Nothing to keep or too large - drop it.  */
+  if (!cookie->retbuf)
+    {
+      cookie->retbuf = _gpgrt_malloc (LOG_RETAIN_SIZE);
+      if (!cookie->retbuf)
+        return;
+    }
+
+  if (size > LOG_RETAIN_SIZE - cookie->retlen)
+    {
+      /* Drop the oldest lines to make room.  */
+      start = 0;
+      if (cookie->head_partial)
+        {
+          p = memchr (cookie->retbuf, '\n', cookie->retlen);
+          start = p? (size_t)(p - cookie->retbuf + 1) : cookie->retlen;
+        }
+      need = size - (LOG_RETAIN_SIZE - cookie->retlen);
+      if (need > cookie->retlen - start)
+        return;  /* No room without cutting the partly sent line.  */
+      p = memchr (cookie->retbuf + start + need - 1, '\n',
+                  cookie->retlen - start - (need - 1));
+      end = p? (size_t)(p - cookie->retbuf + 1) : cookie->retlen;
+      retain_remove (cookie, start, end - start);
+    }
+
+  memcpy (cookie->retbuf + cookie->retlen, buffer, size);
+  cookie->retlen += size;
+}
+
+
+/* Try to send the retained data of COOKIE.  Returns 0 if all data has
+ * been sent, 1 if the socket would block, and -1 on error.  */
+static int
+retain_flush (struct fun_cookie_s *cookie)
+{
+  gpgrt_ssize_t n;
+
+  if (!cookie->retlen)
+    return 0;
+
+  n = sock_send (cookie->fd, cookie->retbuf, cookie->retlen);
+  if (n < 0)
+    return -1;
+  if (n)
+    {
+      cookie->head_partial = (cookie->retbuf[n-1] != '\n');
+      retain_remove (cookie, 0, n);
+    }
+  if (cookie->retlen)
+    return 1;
+  cookie->head_partial = 0;
+  return 0;
+}
+
+
+/* Compute the time for the next connect attempt.  */
+static void
+schedule_reconnect (struct fun_cookie_s *cookie)
+{
+  if (!cookie->backoff)
+    cookie->backoff = 1;
+  else if (cookie->backoff < LOG_BACKOFF_MAX)
+    cookie->backoff *= 2;
+  cookie->next_connect = time (NULL) + cookie->backoff;
+}
+
+
+/* Close the log socket after an error and schedule a reconnect.  */
+static void
+drop_connection (struct fun_cookie_s *cookie)
+{
+  sock_close (cookie->fd);
+  cookie->fd = -1;
+  cookie->connecting = 0;
+  log_socket = -1;
+
+  /* The rest of a partly sent record would be garbage for the new
+   * connection.  */
+  if (cookie->head_partial)
+    {
+      const char *p = memchr (cookie->retbuf, '\n', cookie->retlen);
+
+      retain_remove (cookie, 0,
+                     p? (size_t)(p - cookie->retbuf + 1) : cookie->retlen);
+      cookie->head_partial = 0;
+    }
+
+  schedule_reconnect (cookie);
+}
+
+
+/* Check whether the non-blocking connect of COOKIE has completed.
+ * Returns true if the socket is now connected.  */
+static int
+check_connected (struct fun_cookie_s *cookie)
+{
+#if !defined(HAVE_W32_SYSTEM) && defined(HAVE_POLL_H)
+  struct pollfd pfd;
+  int err;
+  socklen_t errlen = sizeof err;
+
+  pfd.fd = cookie->fd;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  if (poll (&pfd, 1, 0) == 0)
+    {
+      /* Still in progress.  A connect which gets no answer is given
+       * up after the current backoff interval.  */
+      if (time (NULL) < cookie->connect_end)
+        return 0;
+      err = ETIMEDOUT;
+    }
+  else if (getsockopt (cookie->fd, SOL_SOCKET, SO_ERROR, &err, &errlen))
+    err = errno;
+  if (err)
+    {
+      if (!cookie->quiet && !running_detached
+          && isatty (_gpgrt_fileno (es_stderr)))
+        _gpgrt_fprintf (es_stderr, "can't connect to '%s': %s\n",
+                        cookie->name, strerror (err));
+      cookie->quiet = 1;
+      drop_connection (cookie);
+      return 0;
+    }
+  cookie->connecting = 0;
+#endif
+  cookie->backoff = 0;
+  return 1;
+}
+
+
 /* Returns true if STR represents a valid port number in decimal
    notation and no garbage is following.  */
 static int
@@ -213,6 +539,8 @@ static gpgrt_ssize_t
 fun_writer (void *cookie_arg, const void *buffer, size_t size)
 {
   struct fun_cookie_s *cookie = cookie_arg;
+  gpgrt_ssize_t n;
+  int rc;
 
   /* Note that we always try to reconnect to the socket but print
      error messages only the first time an error occurred.  If
@@ -220,8 +548,12 @@ fun_writer (void *cookie_arg, const void *buffer, size_t size)
      not print any error messages.  This is needed because detached
      processes often close stderr and by writing to file descriptor 2
      we might send the log message to a file not intended for logging
-     (e.g. a pipe or network connection). */
-  if (cookie->want_socket && cookie->fd == -1)
+     (e.g. a pipe or network connection).  To avoid a failing connect
+     for each record while the collector is down, the attempts are
+     delayed with an exponential backoff; meanwhile the records are
+     kept in a retention buffer.  */
+  if (cookie->want_socket && cookie->fd == -1
+      && time (NULL) >= cookie->next_connect)
     {
 #ifdef WITH_IPV6
       struct sockaddr_in6 srvr_addr_in6;
@@ -380,19 +712,46 @@ fun_writer (void *cookie_arg, const void *buffer, size_t size)
         }
       else
         {
+#ifndef HAVE_W32_SYSTEM
+          /* A non-blocking socket makes sure that a slow or
+           * unreachable collector does not stall the logging.  */
+          rc = fcntl (cookie->fd, F_GETFL);
+          if (rc != -1)
+            fcntl (cookie->fd, F_SETFL, rc | O_NONBLOCK);
+#endif
           if (connect (cookie->fd, srvr_addr, addrlen) == -1)
             {
-              if (!cookie->quiet && !running_detached
-                  && isatty (_gpgrt_fileno (es_stderr)))
-                _gpgrt_fprintf (es_stderr, "can't connect to '%s%s': %s\n",
-                                cookie->name, name_for_err, strerror(errno));
-              sock_close (cookie->fd);
-              cookie->fd = -1;
+#if !defined(HAVE_W32_SYSTEM) && defined(HAVE_POLL_H)
+              /* Note that EAGAIN for a local socket means that the
+               * listen queue is full and thus we need to try again
+               * later.  */
+              if (errno == EINPROGRESS)
+                {
+                  cookie->connecting = 1;
+                  cookie->connect_end = (time (NULL)
+                                         + (cookie->backoff
+                                            ? cookie->backoff : 1));
+                }
+              else
+#endif
+                {
+                  if (!cookie->quiet && !running_detached
+                      && isatty (_gpgrt_fileno (es_stderr)))
+                    _gpgrt_fprintf (es_stderr,
+                                    "can't connect to '%s%s': %s\n",
+                                    cookie->name, name_for_err,
+                                    strerror(errno));
+                  sock_close (cookie->fd);
+                  cookie->fd = -1;
+                }
             }
+          else
+            cookie->backoff = 0;
         }
 
       if (cookie->fd == -1)
         {
+          schedule_reconnect (cookie);
           if (!running_detached)
             {
               /* Due to all the problems with apps not running
@@ -414,30 +773,63 @@ fun_writer (void *cookie_arg, const void *buffer, size_t size)
         }
     }
 
+  if (cookie->fd != -1 && cookie->connecting)
+    check_connected (cookie);
+
   log_socket = cookie->fd;
-  if (cookie->fd != -1)
+  if (!cookie->want_socket)
     {
-      if (!writen (cookie->fd, buffer, size, cookie->is_socket))
+      if (cookie->fd != -1 && !writen (cookie->fd, buffer, size))
         return (gpgrt_ssize_t)size; /* Okay. */
+      if (!running_detached && cookie->fd != -1
+          && isatty (_gpgrt_fileno (es_stderr)))
+        {
+          if (*cookie->name)
+            _gpgrt_fprintf (es_stderr, "error writing to '%s': %s\n",
+                            cookie->name, strerror(errno));
+          else
+            _gpgrt_fprintf (es_stderr,
+                            "error writing to file descriptor %d: %s\n",
+                            cookie->fd, strerror(errno));
+        }
+      return (gpgrt_ssize_t)size;
     }
 
-  if (!running_detached && cookie->fd != -1
-      && isatty (_gpgrt_fileno (es_stderr)))
+  if (cookie->fd == -1 || cookie->connecting)
     {
-      if (*cookie->name)
-        _gpgrt_fprintf (es_stderr, "error writing to '%s': %s\n",
-                        cookie->name, strerror(errno));
-      else
-        _gpgrt_fprintf (es_stderr, "error writing to file descriptor %d: %s\n",
-                        cookie->fd, strerror(errno));
+      retain_data (cookie, buffer, size);
+      return (gpgrt_ssize_t)size;
     }
-  if (cookie->is_socket && cookie->fd != -1)
+
+  /* Older data needs to be sent first.  */
+  rc = retain_flush (cookie);
+  if (rc > 0)
     {
-      sock_close (cookie->fd);
-      cookie->fd = -1;
-      log_socket = -1;
+      retain_data (cookie, buffer, size);
+      return (gpgrt_ssize_t)size;
+    }
+  if (!rc)
+    {
+      n = sock_send (cookie->fd, buffer, size);
+      if (n >= 0)
+        {
+          if ((size_t)n < size)
+            {
+              /* The socket would block; keep the rest.  */
+              retain_data (cookie, (const char*)buffer + n, size - n);
+              if (n)
+                cookie->head_partial = 1;
+            }
+          return (gpgrt_ssize_t)size; /* Okay. */
+        }
     }
 
+  if (!running_detached && isatty (_gpgrt_fileno (es_stderr)))
+    _gpgrt_fprintf (es_stderr, "error writing to '%s': %s\n",
+                    cookie->name, strerror(errno));
+  drop_connection (cookie);
+  retain_data (cookie, buffer, size);
+
   return (gpgrt_ssize_t)size;
 }
 
@@ -448,101 +840,405 @@ fun_closer (void *cookie_arg)
   struct fun_cookie_s *cookie = cookie_arg;
 
   if (cookie->fd != -1 && cookie->fd != 2)
-    sock_close (cookie->fd);
+    {
+      /* Last chance for the retained data.  */
+      if (!cookie->connecting)
+        retain_flush (cookie);
+      sock_close (cookie->fd);
+    }
+  _gpgrt_free (cookie->retbuf);
   _gpgrt_free (cookie);
   log_socket = -1;
   return 0;
 }
 
 
-/* Common function to either set the logging to a file or a file
-   descriptor. */
-static void
-set_file_fd (const char *name, int fd, estream_t stream)
+#ifndef HAVE_W32_SYSTEM
+/* Cookie used to send each record as one datagram to a local socket.
+   There is no connection; thus the collector may be restarted at any
+   time.  */
+struct dgram_cookie_s
+{
+  int fd;
+  int quiet;
+  struct sockaddr_un addr;
+  socklen_t addrlen;
+};
+
+
+static gpgrt_ssize_t
+dgram_writer (void *cookie_arg, const void *buffer, size_t size)
+{
+  struct dgram_cookie_s *cookie = cookie_arg;
+  int flags = 0;
+
+  if (!size)
+    return 0;  /* Flush request - nothing buffered.  */
+
+#ifdef MSG_DONTWAIT
+  flags |= MSG_DONTWAIT;
+#endif
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+  /* A record which can't be sent right away is dropped; a full
+   * receive queue of the collector must not stall the process.  */
+  while (sendto (cookie->fd, buffer, size, flags,
+                 (struct sockaddr *)&cookie->addr, cookie->addrlen) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      if (!cookie->quiet && !running_detached
+          && isatty (_gpgrt_fileno (es_stderr)))
+        _gpgrt_fprintf (es_stderr, "error sending to '%s': %s\n",
+                        cookie->addr.sun_path, strerror (errno));
+      cookie->quiet = 1;
+      return (gpgrt_ssize_t)size;
+    }
+  cookie->quiet = 0;
+  return (gpgrt_ssize_t)size;
+}
+
+
+static int
+dgram_closer (void *cookie_arg)
+{
+  struct dgram_cookie_s *cookie = cookie_arg;
+
+  close (cookie->fd);
+  _gpgrt_free (cookie);
+  log_socket = -1;
+  return 0;
+}
+
+
+/* Create a stream to send the log to the datagram socket NAME.  */
+static estream_t
+open_dgram_stream (const char *name)
 {
+  es_cookie_io_functions_t io = { NULL };
+  struct dgram_cookie_s *cookie;
   estream_t fp;
-  int want_socket = 0;
-  struct fun_cookie_s *cookie;
 
-  /* Close an open log stream.  */
-  if (logstream)
+  if (strlen (name) >= sizeof cookie->addr.sun_path)
     {
-      if (logstream != es_stderr)
-        _gpgrt_fclose (logstream);
-      logstream = NULL;
+      _gpg_err_set_errno (ENAMETOOLONG);
+      return NULL;
     }
 
-  if (stream)
+  cookie = _gpgrt_calloc (1, sizeof *cookie);
+  if (!cookie)
+    return NULL;
+  cookie->fd = socket (PF_LOCAL, SOCK_DGRAM, 0);
+  if (cookie->fd == -1)
     {
-      /* We don't use a cookie to log directly to a stream.  */
-      fp = stream;
-      goto leave;
+      _gpgrt_free (cookie);
+      return NULL;
     }
+  cookie->addr.sun_family = AF_LOCAL;
+  strcpy (cookie->addr.sun_path, name);
+  cookie->addrlen = SUN_LEN (&cookie->addr);
 
-  /* Figure out what kind of logging we want.  */
-  if (name && !strcmp (name, "-"))
+  io.func_write = dgram_writer;
+  io.func_close = dgram_closer;
+  fp = _gpgrt_fopencookie (cookie, "w", io);
+  if (!fp)
     {
-      fp = es_stderr;
-      goto leave;
+      close (cookie->fd);
+      _gpgrt_free (cookie);
+      return NULL;
     }
-  else if (name && !strncmp (name, "tcp://", 6) && name[6])
-    want_socket = 1;
-#ifndef HAVE_W32_SYSTEM
-  else if (name && !strncmp (name, "socket://", 9))
-    want_socket = 2;
-#endif /*HAVE_W32_SYSTEM*/
+  log_socket = cookie->fd;
+  return fp;
+}
+#endif /*!HAVE_W32_SYSTEM*/
 
-  /* Setup a new stream.  */
 
-  if (!name)
-    fp = _gpgrt_fdopen (fd, "w");
-  else if (!want_socket)
-    fp = _gpgrt_fopen (name, "a");
-  else
-    {
-      es_cookie_io_functions_t io = { NULL };
+/* Cookie used for log files which are rotated.  */
+struct rotate_cookie_s
+{
+  int fd;
+  size_t size;     /* The current size of the file.  */
+  time_t opened;   /* The time the file has been created.  */
+  char name[1];
+};
 
-      cookie = _gpgrt_malloc (sizeof *cookie + (name? strlen (name):0));
-      if (!cookie)
-        return; /* oops */
-      strcpy (cookie->name, name? name:"");
-      cookie->quiet = 0;
-      cookie->is_socket = 0;
-      cookie->want_socket = want_socket;
-      cookie->fd = -1;
-      log_socket = cookie->fd;
 
-      io.func_write = fun_writer;
-      io.func_close = fun_closer;
+/* Open the log file of COOKIE.  Returns the file descriptor or -1.  */
+static int
+rotate_open (struct rotate_cookie_s *cookie)
+{
+  struct stat st;
+  int fd;
 
-      fp = _gpgrt_fopencookie (cookie, "w", io);
-    }
+  fd = open (cookie->name, O_WRONLY|O_APPEND|O_CREAT|O_BINARY,
+             (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH));
+  if (fd == -1)
+    return -1;
+  cookie->size = (!fstat (fd, &st) && st.st_size > 0)? st.st_size : 0;
+  cookie->opened = time (NULL);
+  return fd;
+}
 
-  /* On error default to a stderr based estream.  */
-  if (!fp)
-    fp = es_stderr;
 
- leave:
-  _gpgrt_setvbuf (fp, NULL, _IOLBF, 0);
+/* Rename FROM to TO even if TO exists.  Returns 0 on success or -1
+ * on error.  */
+static int
+rotate_rename (const char *from, const char *to)
+{
+#ifdef HAVE_W32_SYSTEM
+  remove (to);
+#endif
+  return rename (from, to)? -1 : 0;
+}
 
-  logstream = fp;
 
-  /* We always need to print the prefix and the pid for socket mode,
-     so that the server reading the socket can do something
-     meaningful. */
-  force_prefixes = want_socket;
+/* Move the log file of COOKIE to the backup NAME.1 and start a new
+ * one.  Older backups are shifted up to NAME.N; the one beyond is
+ * removed.  The new file is opened before the old one is closed so
+ * that no record is lost if that fails.  */
+static void
+rotate_file (struct rotate_cookie_s *cookie)
+{
+  size_t namelen = strlen (cookie->name);
+  unsigned int nkeep = rotate_nkeep? rotate_nkeep : 1;
+  char *from, *to;
+  unsigned int i;
+  int fd, rc;
+
+  from = _gpgrt_malloc (2 * (namelen + 12));
+  if (!from)
+    return;
+  to = from + namelen + 12;
 
-  missing_lf = 0;
+  for (i = nkeep; i > 1; i--)
+    {
+      snprintf (from, namelen + 12, "%s.%u", cookie->name, i - 1);
+      snprintf (to, namelen + 12, "%s.%u", cookie->name, i);
+      rotate_rename (from, to);
+    }
+  snprintf (to, namelen + 12, "%s.1", cookie->name);
+  rc = rotate_rename (cookie->name, to);
+  _gpgrt_free (from);
+
+  /* If the file could not be renamed, opening it again would only
+   * give us the same file.  */
+  fd = rc? -1 : rotate_open (cookie);
+  if (fd == -1)
+    {
+      /* Keep on using the old file but don't try again for each
+       * record.  */
+      cookie->size = 0;
+      cookie->opened = time (NULL);
+      return;
+    }
+  close (cookie->fd);
+  cookie->fd = fd;
+  log_socket = fd;
 }
 
 
-/* Set the file to write log to.  The special names NULL and "-" may
- * be used to select stderr and names formatted like
- * "socket:///home/foo/mylogs" may be used to write the logging to the
- * socket "/home/foo/mylogs".  If the connection to the socket fails
+static gpgrt_ssize_t
+rotate_writer (void *cookie_arg, const void *buffer, size_t size)
+{
+  struct rotate_cookie_s *cookie = cookie_arg;
+
+  if (!size)
+    return 0;  /* Flush request - nothing buffered.  */
+
+  /* Only a record which does not fit anymore triggers the rotation;
+   * this keeps the costly part out of the common path.  Note that the
+   * file may already be larger than the limit if it existed before or
+   * if a single record exceeded the limit.  */
+  if (cookie->size
+      && ((rotate_maxsize
+           && (cookie->size >= rotate_maxsize
+               || size > rotate_maxsize - cookie->size))
+          || (rotate_maxage
+              && time (NULL) - cookie->opened >= rotate_maxage)))
+    rotate_file (cookie);
+
+  if (writen (cookie->fd, buffer, size))
+    {
+      if (!running_detached && isatty (_gpgrt_fileno (es_stderr)))
+        _gpgrt_fprintf (es_stderr, "error writing to '%s': %s\n",
+                        cookie->name, strerror(errno));
+    }
+  else if (size > (size_t)(-1) - cookie->size)
+    cookie->size = (size_t)(-1);
+  else
+    cookie->size += size;
+
+  return (gpgrt_ssize_t)size;
+}
+
+
+static int
+rotate_closer (void *cookie_arg)
+{
+  struct rotate_cookie_s *cookie = cookie_arg;
+
+  close (cookie->fd);
+  _gpgrt_free (cookie);
+  log_socket = -1;
+  return 0;
+}
+
+
+/* Create a stream to write the log to the file NAME which is rotated
+ * according to the limits set by _gpgrt_log_set_rotate.  */
+static estream_t
+open_rotate_stream (const char *name)
+{
+  es_cookie_io_functions_t io = { NULL };
+  struct rotate_cookie_s *cookie;
+  estream_t fp;
+
+  cookie = _gpgrt_malloc (sizeof *cookie + strlen (name));
+  if (!cookie)
+    return NULL;
+  strcpy (cookie->name, name);
+  cookie->fd = rotate_open (cookie);
+  if (cookie->fd == -1)
+    {
+      _gpgrt_free (cookie);
+      return NULL;
+    }
+
+  io.func_write = rotate_writer;
+  io.func_close = rotate_closer;
+  fp = _gpgrt_fopencookie (cookie, "w", io);
+  if (!fp)
+    {
+      close (cookie->fd);
+      _gpgrt_free (cookie);
+      return NULL;
+    }
+  /* Make sure that gpgrt_log_test_fd knows about our fd.  */
+  log_socket = cookie->fd;
+  return fp;
+}
+
+
+/* Common function to either set the logging to a file or a file
+   descriptor. */
+static void
+set_file_fd (const char *name, int fd, estream_t stream)
+{
+  estream_t fp;
+  int want_socket = 0;
+  int own_stream = 0;
+  struct fun_cookie_s *cookie;
+
+#ifdef USE_ASYNC_LOG
+  /* Queued records belong to the old log stream.  */
+  async_drain ();
+#endif
+  /* And so do the pending rate limit summaries.  */
+  ratelimit_flush ();
+
+  /* Close an open log stream.  */
+  if (logstream)
+    {
+      if (logstream != es_stderr)
+        _gpgrt_fclose (logstream);
+      logstream = NULL;
+    }
+
+  if (stream)
+    {
+      /* We don't use a cookie to log directly to a stream.  */
+      fp = stream;
+      goto leave;
+    }
+
+  /* Figure out what kind of logging we want.  */
+  if (name && !strcmp (name, "-"))
+    {
+      fp = es_stderr;
+      goto leave;
+    }
+  else if (name && !strncmp (name, "tcp://", 6) && name[6])
+    want_socket = 1;
+#ifndef HAVE_W32_SYSTEM
+  else if (name && !strncmp (name, "socket://", 9))
+    want_socket = 2;
+  else if (name && !strncmp (name, "dgram://", 8) && name[8])
+    want_socket = 3;
+#endif /*HAVE_W32_SYSTEM*/
+
+  /* Setup a new stream.  */
+
+  if (!name)
+    fp = _gpgrt_fdopen (fd, "w");
+#ifndef HAVE_W32_SYSTEM
+  else if (want_socket == 3)
+    fp = open_dgram_stream (name + 8);
+#endif
+  else if (!want_socket && (rotate_maxsize || rotate_maxage))
+    fp = open_rotate_stream (name);
+  else if (!want_socket)
+    fp = _gpgrt_fopen (name, "a");
+  else
+    {
+      es_cookie_io_functions_t io = { NULL };
+
+      cookie = _gpgrt_malloc (sizeof *cookie + (name? strlen (name):0));
+      if (!cookie)
+        return; /* oops */
+      strcpy (cookie->name, name? name:"");
+      cookie->quiet = 0;
+      cookie->is_socket = 0;
+      cookie->want_socket = want_socket;
+      cookie->fd = -1;
+      cookie->connecting = 0;
+      cookie->backoff = 0;
+      cookie->next_connect = 0;
+      cookie->retbuf = NULL;
+      cookie->retlen = 0;
+      cookie->head_partial = 0;
+      log_socket = cookie->fd;
+
+      io.func_write = fun_writer;
+      io.func_close = fun_closer;
+
+      fp = _gpgrt_fopencookie (cookie, "w", io);
+    }
+
+  /* On error default to a stderr based estream.  */
+  if (!fp)
+    fp = es_stderr;
+  else
+    own_stream = 1;
+
+ leave:
+  /* Log records are assembled in memory and written with one call;
+   * thus we don't need buffering by our own streams.  The buffering
+   * of the caller's stream and of stderr is not changed.  */
+  if (own_stream)
+    _gpgrt_setvbuf (fp, NULL, _IONBF, 0);
+
+  logstream = fp;
+  flush_logstream = !own_stream;
+
+  /* We always need to print the prefix and the pid for socket mode,
+     so that the server reading the socket can do something
+     meaningful. */
+  force_prefixes = want_socket;
+
+  missing_lf = 0;
+}
+
+
+/* Set the file to write log to.  The special names NULL and "-" may
+ * be used to select stderr and names formatted like
+ * "socket:///home/foo/mylogs" may be used to write the logging to the
+ * socket "/home/foo/mylogs".  If the connection to the socket fails
  * or a write error is detected, the function writes to stderr and
- * tries the next time again to connect the socket.  Calling this
- * function with (NULL, NULL, -1) sets the default sink.
+ * tries the next time again to connect the socket.  A name like
+ * "dgram:///run/foo/log" sends each record as one datagram to that
+ * local socket; records which can't be sent immediately are dropped.
+ * Calling this function with (NULL, NULL, -1) sets the default sink.
  * Warning: This function is not thread-safe.
  */
 void
@@ -566,6 +1262,58 @@ _gpgrt_log_set_sink (const char *name, estream_t stream, int fd)
 }
 
 
+/* Rotate log files written by name if they reach MAXSIZE bytes or
+ * are older than MAXAGE seconds; a value of 0 disables the respective
+ * limit.  The current file is then renamed to NAME.1 and a new file
+ * is started; up to NKEEP old files are kept.  An NKEEP of 0 is
+ * treated as 1.  This needs to be called before _gpgrt_log_set_sink.
+ * Warning: This function is not thread-safe.  */
+void
+_gpgrt_log_set_rotate (size_t maxsize, unsigned int maxage,
+                       unsigned int nkeep)
+{
+  rotate_maxsize = maxsize;
+  rotate_maxage = maxage;
+  rotate_nkeep = nkeep;
+}
+
+
+/* Limit repeated messages to BURST per INTERVAL seconds.  Messages
+ * are identified by their format string and level.  Further messages
+ * are suppressed and summarized by a "last message repeated N times"
+ * line in front of the next message logged for them, or when the
+ * log sink or the rate limit is changed and at exit.  A BURST of 0
+ * disables the rate limit.  Fatal and bug messages, the lines of
+ * timer dumps, and the continuation lines of hexdumps are never
+ * suppressed.  Messages within their burst are checked without
+ * taking a lock; if several threads log the same message
+ * concurrently, slightly more than BURST messages may pass.
+ * Warning: This function is not thread-safe.  */
+void
+_gpgrt_log_set_ratelimit (unsigned int burst, unsigned int interval)
+{
+  static int atexit_registered;
+
+#ifdef USE_ATFORK
+  _gpgrt_lock_lock (&prefix_cache_lock);
+  register_atfork ();
+  _gpgrt_lock_unlock (&prefix_cache_lock);
+#endif
+  if (!atexit_registered)
+    {
+      atexit_registered = 1;
+      atexit (ratelimit_flush);
+    }
+
+  ratelimit_flush ();
+  _gpgrt_lock_lock (&ratelimit_lock);
+  memset (ratelimit_slots, 0, sizeof ratelimit_slots);
+  ratelimit_interval = interval? interval : 1;
+  ratelimit_burst = burst;
+  _gpgrt_lock_unlock (&ratelimit_lock);
+}
+
+
 /* Set a function to retrieve the directory name of a socket if
  * only "socket://" has been given to log_set_file.
  * Warning: This function is not thread-safe.  */
@@ -597,7 +1345,10 @@ _gpgrt_log_set_prefix (const char *text, unsigned int flags)
 
   with_prefix = (flags & GPGRT_LOG_WITH_PREFIX);
   with_time = (flags & GPGRT_LOG_WITH_TIME);
+  time_precision = ((flags & GPGRT_LOG_TIME_USEC)? 6 :
+                    (flags & GPGRT_LOG_TIME_MSEC)? 3 : 0);
   with_pid  = (flags & GPGRT_LOG_WITH_PID);
+  with_json = (flags & GPGRT_LOG_JSON);
   running_detached = (flags & GPGRT_LOG_RUN_DETACHED);
 #ifdef HAVE_W32_SYSTEM
   no_registry = (flags & GPGRT_LOG_NO_REGISTRY);
@@ -605,6 +1356,83 @@ _gpgrt_log_set_prefix (const char *text, unsigned int flags)
 }
 
 
+/* Set the levels which are to be logged.  MASK has the bit
+ * GPGRT_LOGLVL_BIT(LEVEL) set for each level to log; by default all
+ * levels are logged.  Fatal and bug messages are always logged and
+ * GPGRT_LOGLVL_BEGIN and GPGRT_LOGLVL_CONT follow the level of the
+ * record they continue.  Returns the previous mask.  */
+unsigned int
+_gpgrt_log_set_level (unsigned int mask)
+{
+  unsigned int old = log_level_mask;
+
+  log_level_mask = mask;
+  return old;
+}
+
+
+#ifdef USE_THREAD_KEYS
+static void
+create_suppressed_key (void)
+{
+  if (!pthread_key_create (&suppressed_key, NULL))
+    suppressed_key_okay = 1;
+}
+#endif
+
+
+/* Return true if the last record of this thread has been
+ * suppressed.  */
+static int
+get_suppressed_cont (void)
+{
+#ifdef USE_THREAD_KEYS
+  pthread_once (&suppressed_key_once, create_suppressed_key);
+  if (suppressed_key_okay)
+    return !!pthread_getspecific (suppressed_key);
+#endif
+  return suppressed_cont;
+}
+
+
+/* Mark whether the last record of this thread has been suppressed.  */
+static void
+set_suppressed_cont (int value)
+{
+#ifdef USE_THREAD_KEYS
+  pthread_once (&suppressed_key_once, create_suppressed_key);
+  if (suppressed_key_okay)
+    {
+      if (!!pthread_getspecific (suppressed_key) != !!value)
+        pthread_setspecific (suppressed_key, value? (void*)1 : NULL);
+      return;
+    }
+#endif
+  suppressed_cont = value;
+}
+
+
+/* Return true if messages at LEVEL are currently logged.  This is a
+ * cheap test to be used before expensive logging calls.  */
+int
+_gpgrt_log_level_p (int level)
+{
+  switch (level)
+    {
+    case GPGRT_LOGLVL_BEGIN:
+    case GPGRT_LOGLVL_CONT:
+      return !get_suppressed_cont ();
+    case GPGRT_LOGLVL_FATAL:
+    case GPGRT_LOGLVL_BUG:
+      return 1;
+    default:
+      if (level < 0 || level >= 32)
+        return 1;
+      return !!(log_level_mask & GPGRT_LOGLVL_BIT (level));
+    }
+}
+
+
 const char *
 _gpgrt_log_get_prefix (unsigned int *flags)
 {
@@ -615,8 +1443,14 @@ _gpgrt_log_get_prefix (unsigned int *flags)
         *flags |= GPGRT_LOG_WITH_PREFIX;
       if (with_time)
         *flags |= GPGRT_LOG_WITH_TIME;
+      if (time_precision == 3)
+        *flags |= GPGRT_LOG_TIME_MSEC;
+      else if (time_precision == 6)
+        *flags |= GPGRT_LOG_TIME_USEC;
       if (with_pid)
         *flags |= GPGRT_LOG_WITH_PID;
+      if (with_json)
+        *flags |= GPGRT_LOG_JSON;
       if (running_detached)
         *flags |= GPGRT_LOG_RUN_DETACHED;
 #ifdef HAVE_W32_SYSTEM
@@ -796,26 +1630,378 @@ fmt_string_filter (const char *string, int no, void *opaque)
         case '\a': *d++ = '\\'; *d++ = 'a'; break;
         case '\\': *d++ = '\\'; *d++ = '\\'; break;
 
-        default:
-          if (*p < 0x20 || *p == 0x7f)
+        default:
+          if (*p < 0x20 || *p == 0x7f)
+            {
+              snprintf (d, 5, "\\x%02x", *p);
+              d += 4;
+            }
+          else
+            *d++ = *p;
+        }
+    }
+  *d = 0;
+  return state->last_result;
+}
+
+
+/* Initialize the log record REC.  */
+static void
+rec_init (struct logrec_s *rec)
+{
+  rec->buffer = rec->stackbuf;
+  rec->size = sizeof rec->stackbuf;
+  rec->buffer[0] = '\n';
+  rec->len = 1;
+  rec->error = 0;
+  rec->missing_lf = 0;
+}
+
+
+/* Release the resources of the log record REC.  */
+static void
+rec_release (struct logrec_s *rec)
+{
+  if (rec->buffer != rec->stackbuf)
+    _gpgrt_free (rec->buffer);
+  rec->buffer = rec->stackbuf;
+  rec->size = sizeof rec->stackbuf;
+  rec->len = 0;
+}
+
+
+/* Append (BUF,BUFLEN) to the log record OPAQUE.  This is also used as
+ * output function for the printf engine.  If we run out of core the
+ * record is truncated.  */
+static int
+rec_write (void *opaque, const char *buf, size_t buflen)
+{
+  struct logrec_s *rec = opaque;
+  size_t newsize;
+  char *p;
+
+  if (rec->error)
+    return -1;
+
+  if (buflen > rec->size - rec->len)
+    {
+      newsize = rec->size;
+      do
+        {
+          if (newsize > ((size_t)-1) / 2)
+            {
+              rec->error = 1;
+              return -1;
+            }
+          newsize *= 2;
+        }
+      while (buflen > newsize - rec->len);
+
+      if (rec->buffer == rec->stackbuf)
+        {
+          p = _gpgrt_malloc (newsize);
+          if (p)
+            memcpy (p, rec->buffer, rec->len);
+        }
+      else
+        p = _gpgrt_realloc (rec->buffer, newsize);
+      if (!p)
+        {
+          rec->error = 1;
+          return -1;
+        }
+      rec->buffer = p;
+      rec->size = newsize;
+    }
+
+  memcpy (rec->buffer + rec->len, buf, buflen);
+  rec->len += buflen;
+  return 0;
+}
+
+
+/* Append the string S to REC and return its length.  */
+static int
+rec_puts (struct logrec_s *rec, const char *s)
+{
+  size_t n = strlen (s);
+
+  rec_write (rec, s, n);
+  return (int)n;
+}
+
+
+/* Append the character C to REC.  */
+static void
+rec_putc (struct logrec_s *rec, int c)
+{
+  char tmp = c;
+
+  rec_write (rec, &tmp, 1);
+}
+
+
+/* Format into REC and return the number of bytes appended.  */
+static int
+rec_vprintf (struct logrec_s *rec, gpgrt_string_filter_t sf, void *sfvalue,
+             const char *format, va_list arg_ptr)
+{
+  size_t start = rec->len;
+
+  _gpgrt_estream_format (rec_write, rec, sf, sfvalue, format, arg_ptr);
+  return (int)(rec->len - start);
+}
+
+
+static int
+rec_printf (struct logrec_s *rec,
+            const char *format, ...) GPGRT_ATTR_PRINTF(2,3);
+static int
+rec_printf (struct logrec_s *rec, const char *format, ...)
+{
+  va_list arg_ptr;
+  int n;
+
+  va_start (arg_ptr, format);
+  n = rec_vprintf (rec, NULL, NULL, format, arg_ptr);
+  va_end (arg_ptr);
+  return n;
+}
+
+
+/* Write the record (BUFFER,LENGTH) at LEVEL to the log stream.  The
+ * first byte of BUFFER is the LF slot of struct logrec_s.
+ * RECORD_MISSING_LF tells whether the record ends without a LF.  Our
+ * own log streams are unbuffered and the streams of the caller are
+ * flushed after each record; thus the record, including a LF to
+ * terminate the previous record, is written using one write call and
+ * records from other processes sharing the sink can't interleave
+ * with it.  Note: LOGSTREAM is expected to be locked.  */
+static void
+write_record (int level, const char *buffer, size_t length,
+              int record_missing_lf)
+{
+  if (!(missing_lf && level != GPGRT_LOGLVL_CONT))
+    {
+      buffer++;
+      length--;
+    }
+  if (length)
+    {
+      _gpgrt_write_unlocked (logstream, buffer, length, NULL);
+      if (flush_logstream)
+        _gpgrt_fflush_unlocked (logstream);
+    }
+  missing_lf = record_missing_lf;
+}
+
+
+#ifdef USE_ATFORK
+/* Fork handlers to keep the prefix caches consistent in the child.
+ * The log stream is not locked here because that would block the
+ * fork until the writer thread has finished a possibly stalled write
+ * and deadlock a thread which forks while holding the stream lock.
+ * Instead the child re-initializes the stream's lock; see
+ * atfork_child.  */
+static void
+atfork_prepare (void)
+{
+  _gpgrt_lock_lock (&ratelimit_lock);
+  _gpgrt_lock_lock (&prefix_cache_lock);
+}
+
+static void
+atfork_parent (void)
+{
+  _gpgrt_lock_unlock (&prefix_cache_lock);
+  _gpgrt_lock_unlock (&ratelimit_lock);
+}
+
+static void
+atfork_child (void)
+{
+  pid_cache_string[0] = 0;
+#ifdef USE_ASYNC_LOG
+  /* The writer thread does not exist in the child; thus we fall back
+   * to synchronous logging and drop the records still queued in the
+   * parent.  The state object is intentionally leaked because its
+   * mutex may be in an undefined state.  */
+  async_log = NULL;
+#endif
+  /* The only thread of the child is the forking thread.  The log
+   * stream may have been locked by another thread of the parent, for
+   * example by the writer thread, which would deadlock the child's
+   * first log call.  Thus the lock is re-initialized.  */
+  if (logstream)
+    _gpgrt_freset_lock (logstream);
+  _gpgrt_lock_unlock (&prefix_cache_lock);
+  _gpgrt_lock_unlock (&ratelimit_lock);
+}
+
+
+/* Register the fork handlers.  The caller must hold
+ * PREFIX_CACHE_LOCK.  */
+static void
+register_atfork (void)
+{
+  static int registered;
+
+  if (!registered)
+    {
+      registered = 1;
+      pthread_atfork (atfork_prepare, atfork_parent, atfork_child);
+    }
+}
+#endif /*USE_ATFORK*/
+
+
+/* Render the broken down time TP as "YYYY-MM-DD HH:MM:SS" into
+ * BUFFER which must have space for 20 bytes.  */
+static void
+render_time (char *buffer, struct tm *tp)
+{
+  if (tp)
+    snprintf (buffer, 20, "%04d-%02d-%02d %02d:%02d:%02d",
+              1900+tp->tm_year, tp->tm_mon+1, tp->tm_mday,
+              tp->tm_hour, tp->tm_min, tp->tm_sec);
+  else
+    strcpy (buffer, "0000-00-00 00:00:00");
+}
+
+
+/* Store the local time or with UTC set the UTC as "YYYY-MM-DD
+ * HH:MM:SS" into BUFFER, which must have space for 20 bytes, and
+ * return the sub-second part in microseconds.  Breaking down the
+ * local time is costly and thus the result is cached for the current
+ * second.  */
+static unsigned long
+get_time_string (char *buffer, int utc)
+{
+  time_t atime;
+  unsigned long usec;
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval tv;
+
+  if (!gettimeofday (&tv, NULL))
+    {
+      atime = tv.tv_sec;
+      usec = tv.tv_usec;
+    }
+  else
+#endif /*HAVE_GETTIMEOFDAY*/
+    {
+      atime = time (NULL);
+      usec = 0;
+    }
+
+  if (utc)
+    {
+      struct tm *tp;
+#ifdef HAVE_GMTIME_R
+      struct tm tmbuf;
+
+      tp = gmtime_r (&atime, &tmbuf);
+      render_time (buffer, tp);
+#else
+      _gpgrt_lock_lock (&prefix_cache_lock);
+      tp = gmtime (&atime);  /* Protected by PREFIX_CACHE_LOCK.  */
+      render_time (buffer, tp);
+      _gpgrt_lock_unlock (&prefix_cache_lock);
+#endif
+      return usec;
+    }
+
+  _gpgrt_lock_lock (&prefix_cache_lock);
+  if (atime != time_cache_second)
+    {
+      struct tm *tp;
+#ifdef HAVE_LOCALTIME_R
+      struct tm tmbuf;
+
+      tp = localtime_r (&atime, &tmbuf);
+#else
+      tp = localtime (&atime);  /* Protected by PREFIX_CACHE_LOCK.  */
+#endif
+      render_time (time_cache_string, tp);
+      time_cache_second = atime;
+    }
+  memcpy (buffer, time_cache_string, sizeof time_cache_string);
+  _gpgrt_lock_unlock (&prefix_cache_lock);
+
+  return usec;
+}
+
+
+/* Store the string "[PID" for the current process into BUFFER which
+ * must have space for 24 bytes.  If possible the string is cached
+ * and only rendered again after a fork.  */
+static void
+get_pid_string (char *buffer)
+{
+#ifdef USE_ATFORK
+  _gpgrt_lock_lock (&prefix_cache_lock);
+  if (!*pid_cache_string)
+    {
+      register_atfork ();
+      snprintf (pid_cache_string, sizeof pid_cache_string, "[%u",
+                (unsigned int)getpid ());
+    }
+  memcpy (buffer, pid_cache_string, sizeof pid_cache_string);
+  _gpgrt_lock_unlock (&prefix_cache_lock);
+#else
+  snprintf (buffer, sizeof pid_cache_string, "[%u", (unsigned int)getpid ());
+#endif
+}
+
+
+/* Buffer size required by format_timestamp.  */
+#define TIMESTAMP_SIZE (19 + 1 + 6 + 1)
+
+/* Store the current time into TIMEBUF which must have a size of at
+ * least TIMESTAMP_SIZE bytes and return the used length.  The format
+ * is "YYYY-MM-DD HH:MM:SS"; if ISO is set the ISO-8601 format
+ * "YYYY-MM-DDTHH:MM:SS" is used and the fraction of the second as
+ * requested by TIME_PRECISION is appended.  If UTC is set the ISO
+ * format is used for the UTC and a "Z" is appended.  No 0 is
+ * appended.  */
+static size_t
+format_timestamp (char *timebuf, int iso, int utc)
+{
+  char tmp[20];
+  unsigned long usec;
+  char *p;
+  int i;
+
+  if (utc)
+    iso = 1;
+  usec = get_time_string (tmp, utc);
+  memcpy (timebuf, tmp, 19);
+  p = timebuf + 19;
+  if (iso)
+    {
+      timebuf[10] = 'T';
+      if (time_precision)
+        {
+          if (time_precision == 3)
+            usec /= 1000;
+          *p++ = '.';
+          for (i = time_precision - 1; i >= 0; i--)
             {
-              snprintf (d, 5, "\\x%02x", *p);
-              d += 4;
+              p[i] = '0' + (usec % 10);
+              usec /= 10;
             }
-          else
-            *d++ = *p;
+          p += time_precision;
         }
+      if (utc)
+        *p++ = 'Z';
     }
-  *d = 0;
-  return state->last_result;
+  return p - timebuf;
 }
 
 
-/* Note: LOGSTREAM is expected to be locked.  */
 static int
-print_prefix (int level, int leading_backspace)
+print_prefix (struct logrec_s *rec, int level, int leading_backspace)
 {
-  int rc;
   int length = 0;
 
   if (level != GPGRT_LOGLVL_CONT)
@@ -823,40 +2009,35 @@ print_prefix (int level, int leading_backspace)
        * need to print to a buffer first */
       if (with_time && !force_prefixes)
         {
-          struct tm *tp;
-          time_t atime = time (NULL);
-
-          tp = localtime (&atime);
-          rc = _gpgrt_fprintf_unlocked (logstream,
-                                        "%04d-%02d-%02d %02d:%02d:%02d ",
-                               1900+tp->tm_year, tp->tm_mon+1, tp->tm_mday,
-                               tp->tm_hour, tp->tm_min, tp->tm_sec );
-          if (rc > 0)
-            length += rc;
+          char timebuf[TIMESTAMP_SIZE + 1];
+          size_t n;
+
+          n = format_timestamp (timebuf, !!time_precision, 0);
+          timebuf[n++] = ' ';
+          rec_write (rec, timebuf, n);
+          length += n;
         }
       if (with_prefix || force_prefixes)
-        {
-          _gpgrt_fputs_unlocked (prefix_buffer, logstream);
-          length += strlen (prefix_buffer);
-        }
+        length += rec_puts (rec, prefix_buffer);
       if (with_pid || force_prefixes)
         {
+          char pidbuf[sizeof pid_cache_string];
           unsigned long pidsuf;
           int pidfmt;
 
+          get_pid_string (pidbuf);
+          length += rec_puts (rec, pidbuf);
           if (get_pid_suffix_cb && (pidfmt=get_pid_suffix_cb (&pidsuf)))
-            rc = _gpgrt_fprintf_unlocked (logstream,
-                                          pidfmt == 1? "[%u.%lu]":"[%u.%lx]",
-                                          (unsigned int)getpid (), pidsuf);
+            length += rec_printf (rec, pidfmt == 1? ".%lu]":".%lx]", pidsuf);
           else
-            rc = _gpgrt_fprintf_unlocked (logstream, "[%u]",
-                                          (unsigned int)getpid ());
-          if (rc > 0)
-            length += rc;
+            {
+              rec_putc (rec, ']');
+              length++;
+            }
         }
       if ((!with_time && (with_prefix || with_pid)) || force_prefixes)
         {
-          _gpgrt_putc_unlocked (':', logstream);
+          rec_putc (rec, ':');
           length++;
         }
       /* A leading backspace suppresses the extra space so that we can
@@ -864,7 +2045,7 @@ print_prefix (int level, int leading_backspace)
       if (!leading_backspace
           && (with_time || with_prefix || with_pid || force_prefixes))
         {
-          _gpgrt_putc_unlocked (' ', logstream);
+          rec_putc (rec, ' ');
           length++;
         }
     }
@@ -877,22 +2058,16 @@ print_prefix (int level, int leading_backspace)
     case GPGRT_LOGLVL_WARN: break;
     case GPGRT_LOGLVL_ERROR: break;
     case GPGRT_LOGLVL_FATAL:
-      _gpgrt_fputs_unlocked ("Fatal: ", logstream);
-      length += 7;
+      length += rec_puts (rec, "Fatal: ");
       break;
     case GPGRT_LOGLVL_BUG:
-      _gpgrt_fputs_unlocked ("Ohhhh jeeee: ", logstream);
-      length += 13;
+      length += rec_puts (rec, "Ohhhh jeeee: ");
       break;
     case GPGRT_LOGLVL_DEBUG:
-      _gpgrt_fputs_unlocked ("DBG: ", logstream);
-      length += 5;
+      length += rec_puts (rec, "DBG: ");
       break;
     default:
-      rc = _gpgrt_fprintf_unlocked (logstream,
-                                    "[Unknown log level %d]: ", level);
-      if (rc > 0)
-        length += rc;
+      length += rec_printf (rec, "[Unknown log level %d]: ", level);
       break;
     }
 
@@ -900,16 +2075,595 @@ print_prefix (int level, int leading_backspace)
 }
 
 
-/* Internal worker function.  Exported so that we can use it in
- * visibility.c.  Returns the number of characters printed sans prefix
- * or 0 if the line ends in a LF. */
-int
-_gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
-                      const char *prefmt, const char *fmt, va_list arg_ptr)
+
+/* Escape table for JSON strings: 0 means that the byte is copied
+ * verbatim, 'u' that it is written as "\u00XX" and any other value is
+ * the character to write after a backslash.  Bytes with the high bit
+ * set are copied if they are part of a valid UTF-8 sequence and
+ * otherwise written as "\u00XX".  */
+static const unsigned char json_escapes[256] =
+  {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+      0,   0, '"',   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0, '\\',   0,   0,   0
+    /* All other bytes are copied.  */
+  };
+
+
+/* Return the length of the valid UTF-8 sequence at S which ends
+ * before END or 0 if it is not valid.  */
+static size_t
+utf8_seqlen (const unsigned char *s, const unsigned char *end)
+{
+  size_t n, i;
+
+  if (*s >= 0xc2 && *s <= 0xdf)
+    n = 2;
+  else if (*s >= 0xe0 && *s <= 0xef)
+    n = 3;
+  else if (*s >= 0xf0 && *s <= 0xf4)
+    n = 4;
+  else
+    return 0;
+  if ((size_t)(end - s) < n)
+    return 0;
+  for (i=1; i < n; i++)
+    if ((s[i] & 0xc0) != 0x80)
+      return 0;
+  /* Reject overlong forms, surrogates and values above U+10FFFF.  */
+  if ((*s == 0xe0 && s[1] < 0xa0) || (*s == 0xed && s[1] > 0x9f)
+      || (*s == 0xf0 && s[1] < 0x90) || (*s == 0xf4 && s[1] > 0x8f))
+    return 0;
+  return n;
+}
+
+
+/* Append (STRING,LENGTH) to REC as the content of a JSON string.  */
+static void
+rec_put_json (struct logrec_s *rec, const char *string, size_t length)
+{
+  static const char hexdigits[] = "0123456789abcdef";
+  const unsigned char *s = (const unsigned char *)string;
+  const unsigned char *end = s + length;
+  const unsigned char *run;
+  size_t n;
+  char tmp[6];
+
+  while (s < end)
+    {
+      /* Copy the longest run not requiring an escape in one go.  */
+      for (run = s; s < end; s++)
+        {
+          if (*s < 0x80)
+            {
+              if (json_escapes[*s])
+                break;
+            }
+          else if ((n = utf8_seqlen (s, end)))
+            s += n - 1;
+          else
+            break;
+        }
+      if (s > run)
+        rec_write (rec, (const char *)run, s - run);
+      if (s == end)
+        break;
+
+      tmp[0] = '\\';
+      if (*s >= 0x80 || json_escapes[*s] == 'u')
+        {
+          tmp[1] = 'u';
+          tmp[2] = '0';
+          tmp[3] = '0';
+          tmp[4] = hexdigits[*s >> 4];
+          tmp[5] = hexdigits[*s & 15];
+          rec_write (rec, tmp, 6);
+        }
+      else
+        {
+          tmp[1] = json_escapes[*s];
+          rec_write (rec, tmp, 2);
+        }
+      s++;
+    }
+}
+
+
+/* Assemble a log record at LEVEL as a JSON object into REC.  The
+ * arguments are the same as for _gpgrt_logv_internal.  The object is
+ * always terminated by a LF; a trailing LF of the message is not
+ * included.  Continuation lines are thus written as separate objects
+ * with the level "cont".  The time, pid and prefix fields are
+ * included under the same conditions as in the text format; the time
+ * is given as UTC.  */
+static void
+json_record (struct logrec_s *rec, int level, int ignore_arg_ptr,
+             const char *extrastring, const char *prefmt,
+             const char *fmt, va_list arg_ptr)
+{
+  struct logrec_s msg;
+  char timebuf[TIMESTAMP_SIZE];
+  char pidbuf[sizeof pid_cache_string];
+  unsigned long pidsuf;
+  int pidfmt;
+  const char *name;
+  size_t n;
+
+  if (!fmt && !extrastring)
+    return;  /* No record to open or close in this format.  */
+
+  switch (level)
+    {
+    case GPGRT_LOGLVL_BEGIN: name = "begin"; break;
+    case GPGRT_LOGLVL_CONT:  name = "cont"; break;
+    case GPGRT_LOGLVL_INFO:  name = "info"; break;
+    case GPGRT_LOGLVL_WARN:  name = "warn"; break;
+    case GPGRT_LOGLVL_ERROR: name = "error"; break;
+    case GPGRT_LOGLVL_FATAL: name = "fatal"; break;
+    case GPGRT_LOGLVL_BUG:   name = "bug"; break;
+    case GPGRT_LOGLVL_DEBUG: name = "debug"; break;
+    default: name = "unknown"; break;
+    }
+
+  rec_putc (rec, '{');
+  if (with_time && !force_prefixes)
+    {
+      rec_puts (rec, "\"time\":\"");
+      n = format_timestamp (timebuf, 1, 1);
+      rec_write (rec, timebuf, n);
+      rec_puts (rec, "\",");
+    }
+  if (with_pid || force_prefixes)
+    {
+      get_pid_string (pidbuf);
+      rec_printf (rec, "\"pid\":%s,", pidbuf + 1);
+      if (get_pid_suffix_cb && (pidfmt=get_pid_suffix_cb (&pidsuf)))
+        rec_printf (rec, (pidfmt == 1
+                          ? "\"pidsuffix\":\"%lu\","
+                          : "\"pidsuffix\":\"%lx\","), pidsuf);
+    }
+  rec_printf (rec, "\"level\":\"%s\"", name);
+  if (with_prefix || force_prefixes)
+    {
+      rec_puts (rec, ",\"prefix\":\"");
+      rec_put_json (rec, prefix_buffer, strlen (prefix_buffer));
+      rec_putc (rec, '"');
+    }
+  rec_puts (rec, ",\"msg\":\"");
+
+  /* The message is formatted first so that it can be escaped.  */
+  rec_init (&msg);
+  if (prefmt)
+    rec_puts (&msg, prefmt);
+  if (fmt && *fmt == '\b')
+    fmt++;
+  /* There is no need to sanitize the "%s" args because the entire
+   * message is escaped.  */
+  if (fmt && ignore_arg_ptr)
+    rec_puts (&msg, fmt);
+  else if (fmt)
+    rec_vprintf (&msg, NULL, NULL, fmt, arg_ptr);
+  /* Skip the LF slot and a trailing LF.  */
+  n = msg.len - 1;
+  if (n && msg.buffer[msg.len - 1] == '\n')
+    n--;
+  rec_put_json (rec, msg.buffer + 1, n);
+  if (msg.error)
+    rec->error = 1;
+  rec_release (&msg);
+  rec_putc (rec, '"');
+
+  if (extrastring)
+    {
+      rec_puts (rec, ",\"extra\":\"");
+      rec_put_json (rec, extrastring, strlen (extrastring));
+      rec_putc (rec, '"');
+    }
+  rec_puts (rec, "}\n");
+}
+
+
+/* Same as json_record but for a STRING which is not formatted.  */
+static void
+json_record_string (struct logrec_s *rec, int level, const char *string, ...)
+{
+  va_list arg_ptr;
+
+  va_start (arg_ptr, string);
+  json_record (rec, level, 1, NULL, NULL, string, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+/* Write the NOTE, which must end in a LF, as a record at LEVEL
+ * directly to the log stream.  */
+static void
+write_note (int level, const char *note)
+{
+  struct logrec_s rec;
+
+  rec_init (&rec);
+  if (with_json)
+    json_record_string (&rec, level, note);
+  else
+    {
+      print_prefix (&rec, level, 0);
+      rec_puts (&rec, note);
+    }
+  _gpgrt_flockfile (logstream);
+  write_record (level, rec.buffer, rec.len, 0);
+  _gpgrt_funlockfile (logstream);
+  rec_release (&rec);
+}
+
+
+#ifdef USE_ASYNC_LOG
+/* Write a note about DROPPED records which could not be queued.  */
+static void
+async_write_dropped_note (unsigned long dropped)
+{
+  char note[80];
+
+  snprintf (note, sizeof note, "(%lu log records dropped)\n", dropped);
+  write_note (GPGRT_LOGLVL_INFO, note);
+}
+
+
+/* The thread writing the queued records to the log stream.  */
+static void *
+async_writer_thread (void *arg)
+{
+  struct async_log_s *al = arg;
+  struct async_rec_s *item;
+  unsigned long dropped;
+
+  pthread_mutex_lock (&al->mutex);
+  for (;;)
+    {
+      while (!al->count && !al->dropped && !al->stop)
+        pthread_cond_wait (&al->notempty, &al->mutex);
+      if (!al->count && !al->dropped)
+        break;  /* Stop requested and the queue is empty.  */
+
+      item = NULL;
+      if (al->count)
+        {
+          item = al->ring[al->head];
+          al->head = (al->head + 1) % al->nslots;
+          al->count--;
+          pthread_cond_signal (&al->notfull);
+        }
+      dropped = al->dropped;
+      al->dropped = 0;
+      al->busy = 1;
+      pthread_mutex_unlock (&al->mutex);
+
+      if (dropped)
+        async_write_dropped_note (dropped);
+      if (item)
+        {
+          _gpgrt_flockfile (logstream);
+          write_record (item->level, item->data, item->len, item->missing_lf);
+          _gpgrt_funlockfile (logstream);
+          _gpgrt_free (item);
+        }
+
+      pthread_mutex_lock (&al->mutex);
+      al->busy = 0;
+      if (!al->count)
+        pthread_cond_broadcast (&al->idle);
+    }
+  pthread_cond_broadcast (&al->idle);
+  pthread_mutex_unlock (&al->mutex);
+  return NULL;
+}
+
+
+/* Queue a copy of the record REC for the writer thread.  If the
+ * queue is full the record is dropped or, if requested, we wait
+ * until the writer took a record.  */
+static void
+async_put (int level, struct logrec_s *rec)
+{
+  struct async_log_s *al = async_log;
+  struct async_rec_s *item;
+
+  item = _gpgrt_malloc (sizeof *item + rec->len);
+  if (item)
+    {
+      item->level = level;
+      item->missing_lf = rec->missing_lf;
+      item->len = rec->len;
+      memcpy (item->data, rec->buffer, rec->len);
+    }
+
+  pthread_mutex_lock (&al->mutex);
+  if (item && al->block)
+    while (al->count == al->nslots)
+      pthread_cond_wait (&al->notfull, &al->mutex);
+  if (!item || al->count == al->nslots)
+    {
+      al->dropped++;
+      pthread_mutex_unlock (&al->mutex);
+      _gpgrt_free (item);
+      return;
+    }
+  al->ring[(al->head + al->count) % al->nslots] = item;
+  al->count++;
+  pthread_cond_signal (&al->notempty);
+  pthread_mutex_unlock (&al->mutex);
+}
+
+
+/* Wait until the writer thread has written all queued records.  */
+static void
+async_drain (void)
+{
+  struct async_log_s *al = async_log;
+
+  if (!al)
+    return;
+
+  pthread_mutex_lock (&al->mutex);
+  while ((al->count || al->busy) && !al->stop)
+    pthread_cond_wait (&al->idle, &al->mutex);
+  pthread_mutex_unlock (&al->mutex);
+}
+
+
+/* Write out all queued records and terminate the writer thread.  */
+static void
+async_stop (void)
+{
+  struct async_log_s *al = async_log;
+
+  if (!al)
+    return;
+
+  pthread_mutex_lock (&al->mutex);
+  al->stop = 1;
+  pthread_cond_signal (&al->notempty);
+  pthread_mutex_unlock (&al->mutex);
+  pthread_join (al->thread, NULL);
+
+  async_log = NULL;
+  pthread_cond_destroy (&al->idle);
+  pthread_cond_destroy (&al->notfull);
+  pthread_cond_destroy (&al->notempty);
+  pthread_mutex_destroy (&al->mutex);
+  _gpgrt_free (al);
+}
+#endif /*USE_ASYNC_LOG*/
+
+
+/* Switch logging to an asynchronous mode where log records are
+ * formatted by the caller but written by a background thread.  This
+ * avoids that slow log sinks stall the logging threads.  NRECORDS is
+ * the maximum number of queued records; if the queue is full further
+ * records are dropped unless GPGRT_LOG_ASYNC_BLOCK is given in FLAGS,
+ * in which case the caller waits.  Fatal and bug messages are always
+ * written synchronously after the queue has been drained.  With
+ * NRECORDS given as 0 the queue is drained and synchronous logging is
+ * restored.  A larger NRECORDS than ASYNC_LOG_MAX_RECORDS is
+ * rejected.  Asynchronous logging can't be used with a syscall clamp.
+ * A child process created by fork logs synchronously; the records
+ * still queued in the parent at the time of the fork are not written
+ * by the child.
+ * Warning: This function is not thread-safe.  */
+gpg_err_code_t
+_gpgrt_log_set_async (unsigned int flags, unsigned int nrecords)
+{
+#ifdef USE_ASYNC_LOG
+  static int initialized;
+  struct async_log_s *al;
+  void (*pre)(void);
+  void (*post)(void);
+  int rc;
+
+  async_stop ();
+  if (!nrecords)
+    return 0;
+
+  _gpgrt_get_syscall_clamp (&pre, &post);
+  if (pre || post)
+    return GPG_ERR_NOT_SUPPORTED;
+
+  if (nrecords > ASYNC_LOG_MAX_RECORDS)
+    return GPG_ERR_INV_VALUE;
+  al = _gpgrt_calloc (1, sizeof *al + (nrecords - 1) * sizeof *al->ring);
+  if (!al)
+    return _gpg_err_code_from_syserror ();
+  al->nslots = nrecords;
+  al->block = !!(flags & GPGRT_LOG_ASYNC_BLOCK);
+
+  pthread_mutex_init (&al->mutex, NULL);
+  pthread_cond_init (&al->notempty, NULL);
+  pthread_cond_init (&al->notfull, NULL);
+  pthread_cond_init (&al->idle, NULL);
+  rc = pthread_create (&al->thread, NULL, async_writer_thread, al);
+  if (rc)
+    {
+      pthread_cond_destroy (&al->idle);
+      pthread_cond_destroy (&al->notfull);
+      pthread_cond_destroy (&al->notempty);
+      pthread_mutex_destroy (&al->mutex);
+      _gpgrt_free (al);
+      return _gpg_err_code_from_errno (rc);
+    }
+
+  if (!initialized)
+    {
+      initialized = 1;
+      _gpgrt_lock_lock (&prefix_cache_lock);
+      register_atfork ();
+      _gpgrt_lock_unlock (&prefix_cache_lock);
+      atexit (async_stop);
+    }
+
+  async_log = al;
+  return 0;
+#else /*!USE_ASYNC_LOG*/
+  (void)flags;
+  return nrecords? GPG_ERR_NOT_SUPPORTED : 0;
+#endif /*!USE_ASYNC_LOG*/
+}
+
+
+/* Check whether the message with FMT at LEVEL may be logged under
+ * the rate limit.  Returns true if the message shall be suppressed.
+ * If the message is to be logged, the number of its suppressed
+ * repetitions is stored at R_REPEATED.  If the slot had been used by
+ * another message, the number of its suppressed repetitions is
+ * stored at R_OTHERS instead.
+ *
+ * A message within its burst does not take the lock; the lock is
+ * only taken to start a new interval, to suppress a message, or to
+ * take the summary of suppressed messages.  The unlocked update of
+ * the counter may race with other threads logging the same message
+ * and thus let a few more messages pass than the burst allows.  */
+static int
+ratelimit_check (const char *fmt, int level,
+                 unsigned int *r_repeated, unsigned int *r_others)
+{
+  unsigned int idx;
+  time_t now;
+  int suppress = 0;
+
+  *r_repeated = *r_others = 0;
+  idx = (((unsigned long)(size_t)fmt >> 3) ^ level) % RATELIMIT_SLOTS;
+  now = time (NULL);
+
+  if (ratelimit_slots[idx].fmt == fmt && ratelimit_slots[idx].level == level
+      && now - ratelimit_slots[idx].start < ratelimit_interval
+      && ratelimit_slots[idx].count < ratelimit_burst
+      && !ratelimit_slots[idx].suppressed)
+    {
+      ratelimit_slots[idx].count++;
+      return 0;
+    }
+
+  _gpgrt_lock_lock (&ratelimit_lock);
+  if (ratelimit_slots[idx].fmt != fmt || ratelimit_slots[idx].level != level)
+    {
+      *r_others = ratelimit_slots[idx].suppressed;
+      ratelimit_slots[idx].fmt = fmt;
+      ratelimit_slots[idx].level = level;
+      ratelimit_slots[idx].start = now;
+      ratelimit_slots[idx].count = 0;
+      ratelimit_slots[idx].suppressed = 0;
+    }
+  else if (now - ratelimit_slots[idx].start >= ratelimit_interval)
+    {
+      ratelimit_slots[idx].start = now;
+      ratelimit_slots[idx].count = 0;
+    }
+
+  if (ratelimit_slots[idx].count < ratelimit_burst)
+    {
+      ratelimit_slots[idx].count++;
+      *r_repeated = ratelimit_slots[idx].suppressed;
+      ratelimit_slots[idx].suppressed = 0;
+    }
+  else
+    {
+      ratelimit_slots[idx].suppressed++;
+      suppress = 1;
+    }
+  _gpgrt_lock_unlock (&ratelimit_lock);
+
+  return suppress;
+}
+
+
+/* Write the summaries of messages suppressed by the rate limit which
+ * have not yet been reported.  This is done before the log sink or
+ * the rate limit is changed and at process termination.  */
+static void
+ratelimit_flush (void)
+{
+  unsigned int pending[RATELIMIT_SLOTS];
+  int levels[RATELIMIT_SLOTS];
+  unsigned int idx;
+  int any = 0;
+  char note[80];
+
+  if (!logstream)
+    return;
+
+  _gpgrt_lock_lock (&ratelimit_lock);
+  for (idx=0; idx < RATELIMIT_SLOTS; idx++)
+    {
+      pending[idx] = ratelimit_slots[idx].suppressed;
+      levels[idx] = ratelimit_slots[idx].level;
+      ratelimit_slots[idx].suppressed = 0;
+      if (pending[idx])
+        any = 1;
+    }
+  _gpgrt_lock_unlock (&ratelimit_lock);
+  if (!any)
+    return;
+
+#ifdef USE_ASYNC_LOG
+  /* The summaries go after the queued records.  */
+  async_drain ();
+#endif
+  for (idx=0; idx < RATELIMIT_SLOTS; idx++)
+    if (pending[idx])
+      {
+        snprintf (note, sizeof note,
+                  "last message repeated %u times\n", pending[idx]);
+        write_note (levels[idx], note);
+      }
+}
+
+
+/* Internal worker function.  Returns the number of characters
+ * printed sans prefix or 0 if the line ends in a LF.  If NO_RATELIMIT
+ * is set the message is not subject to the rate limit.  */
+static int
+logv_internal (int level, int ignore_arg_ptr, int no_ratelimit,
+               const char *extrastring,
+               const char *prefmt, const char *fmt, va_list arg_ptr)
 {
   int leading_backspace = (fmt && *fmt == '\b');
   int length, prefixlen;
-  int rc;
+  struct logrec_s rec;
+  unsigned int repeated = 0;
+  unsigned int others = 0;
+
+  /* Check the level first so that suppressed messages are not even
+   * formatted.  */
+  if (!_gpgrt_log_level_p (level))
+    {
+      if (level != GPGRT_LOGLVL_BEGIN && level != GPGRT_LOGLVL_CONT)
+        set_suppressed_cont (1);
+      if (level == GPGRT_LOGLVL_ERROR)
+        _gpgrt_inc_errorcount ();
+      return 0;
+    }
+  /* The rate limit does not apply to continuations and to messages
+   * which terminate the process.  */
+  if (ratelimit_burst && fmt && !no_ratelimit
+      && level != GPGRT_LOGLVL_BEGIN && level != GPGRT_LOGLVL_CONT
+      && level != GPGRT_LOGLVL_FATAL && level != GPGRT_LOGLVL_BUG
+      && ratelimit_check (fmt, level, &repeated, &others))
+    {
+      set_suppressed_cont (1);
+      if (level == GPGRT_LOGLVL_ERROR)
+        _gpgrt_inc_errorcount ();
+      return 0;
+    }
+  if (level != GPGRT_LOGLVL_BEGIN && level != GPGRT_LOGLVL_CONT)
+    set_suppressed_cont (0);
 
   if (!logstream)
     {
@@ -933,22 +2687,47 @@ _gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
         }
     }
 
-  _gpgrt_flockfile (logstream);
-  if (missing_lf && level != GPGRT_LOGLVL_CONT)
-    _gpgrt_putc_unlocked ('\n', logstream );
-  missing_lf = 0;
+  /* The record is assembled first so that it can be handed over to
+   * the writer thread in async mode.  */
+  rec_init (&rec);
+
+  /* A summary for messages suppressed by the rate limit is put in
+   * front of the message.  */
+  if (repeated || others)
+    {
+      char note[80];
+
+      if (others)
+        snprintf (note, sizeof note,
+                  "%u messages suppressed by the rate limit\n", others);
+      else
+        snprintf (note, sizeof note,
+                  "last message repeated %u times\n", repeated);
+      if (with_json)
+        json_record (&rec, level, 1, NULL, NULL, note, arg_ptr);
+      else
+        {
+          print_prefix (&rec, level, 0);
+          rec_puts (&rec, note);
+        }
+    }
 
-  length = print_prefix (level, leading_backspace);
+  if (with_json)
+    {
+      json_record (&rec, level, ignore_arg_ptr, extrastring, prefmt,
+                   fmt, arg_ptr);
+      length = prefixlen = 0;
+      goto record_ready;
+    }
+
+  length = print_prefix (&rec, level, leading_backspace);
   if (leading_backspace)
     fmt++;
 
   if (fmt)
     {
       if (prefmt)
-        {
-          _gpgrt_fputs_unlocked (prefmt, logstream);
-          length += strlen (prefmt);
-        }
+        length += rec_puts (&rec, prefmt);
       prefixlen = length;
 
       if (ignore_arg_ptr)
@@ -960,102 +2739,107 @@ _gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
           const char *p, *pend;
 
           for (p = fmt; (pend = strchr (p, '\n')); p = pend+1)
-            {
-              rc = _gpgrt_fprintf_unlocked (logstream, "%*s%.*s",
-                                 (int)((p != fmt
-                                        && (with_prefix || force_prefixes))
-                                       ?strlen (prefix_buffer)+2:0), "",
-                                 (int)(pend - p)+1, p);
-              if (rc > 0)
-                length += rc;
-            }
-          _gpgrt_fputs_unlocked (p, logstream);
-          length += strlen (p);
+            length += rec_printf (&rec, "%*s%.*s",
+                                  (int)((p != fmt
+                                         && (with_prefix || force_prefixes))
+                                        ?strlen (prefix_buffer)+2:0), "",
+                                  (int)(pend - p)+1, p);
+          length += rec_puts (&rec, p);
         }
       else
         {
           struct fmt_string_filter_s sf = {NULL};
 
-          rc = _gpgrt_vfprintf_unlocked (logstream, fmt_string_filter, &sf,
-                                         fmt, arg_ptr);
-          if (rc > 0)
-            length += rc;
+          length += rec_vprintf (&rec, fmt_string_filter, &sf, fmt, arg_ptr);
         }
 
       if (*fmt && fmt[strlen(fmt)-1] != '\n')
-        missing_lf = 1;
+        rec.missing_lf = 1;
     }
   else
     prefixlen = length;
 
-  /* If we have an EXTRASTRING print it now while we still hold the
-   * lock on the logstream.  */
+  /* If we have an EXTRASTRING append it now to the same record.  */
   if (extrastring)
     {
       int c;
 
-      if (missing_lf)
+      if (rec.missing_lf)
         {
-          _gpgrt_putc_unlocked ('\n', logstream);
-          missing_lf = 0;
+          rec_putc (&rec, '\n');
+          rec.missing_lf = 0;
           length = 0;
         }
-      length += print_prefix (level, leading_backspace);
-      _gpgrt_fputs_unlocked (">> ", logstream);
-      length += 3;
-      missing_lf = 1;
+      length += print_prefix (&rec, level, leading_backspace);
+      length += rec_puts (&rec, ">> ");
+      rec.missing_lf = 1;
       while ((c = *extrastring++))
         {
-          missing_lf = 1;
+          rec.missing_lf = 1;
           if (c == '\\')
-            {
-              _gpgrt_fputs_unlocked ("\\\\", logstream);
-              length += 2;
-            }
+            length += rec_puts (&rec, "\\\\");
           else if (c == '\r')
-            {
-              _gpgrt_fputs_unlocked ("\\r", logstream);
-              length += 2;
-            }
+            length += rec_puts (&rec, "\\r");
           else if (c == '\n')
             {
-              _gpgrt_fputs_unlocked ("\\n\n", logstream);
+              rec_puts (&rec, "\\n\n");
               length = 0;
               if (*extrastring)
                 {
-                  length += print_prefix (level, leading_backspace);
-                  _gpgrt_fputs_unlocked (">> ", logstream);
-                  length += 3;
+                  length += print_prefix (&rec, level, leading_backspace);
+                  length += rec_puts (&rec, ">> ");
                 }
               else
-                missing_lf = 0;
+                rec.missing_lf = 0;
             }
           else
             {
-              _gpgrt_putc_unlocked (c, logstream);
+              rec_putc (&rec, c);
               length++;
             }
         }
-      if (missing_lf)
+      if (rec.missing_lf)
         {
-          _gpgrt_putc_unlocked ('\n', logstream);
+          rec_putc (&rec, '\n');
           length = 0;
-          missing_lf = 0;
+          rec.missing_lf = 0;
+        }
+    }
+
+  if (level == GPGRT_LOGLVL_FATAL || level == GPGRT_LOGLVL_BUG)
+    {
+      if (rec.missing_lf)
+        rec_putc (&rec, '\n');
+      rec.missing_lf = 0;
+    }
+
+ record_ready:
+
+#ifdef USE_ASYNC_LOG
+  if (async_log)
+    {
+      if (level != GPGRT_LOGLVL_FATAL && level != GPGRT_LOGLVL_BUG)
+        {
+          async_put (level, &rec);
+          goto leave;
         }
+      /* Make sure that all pending records have been written before
+       * the process terminates.  */
+      async_drain ();
     }
+#endif /*USE_ASYNC_LOG*/
+
+  _gpgrt_flockfile (logstream);
+  write_record (level, rec.buffer, rec.len, rec.missing_lf);
 
   if (level == GPGRT_LOGLVL_FATAL)
     {
-      if (missing_lf)
-        _gpgrt_putc_unlocked ('\n', logstream);
       run_post_log_funcs (level);
       _gpgrt_funlockfile (logstream);
       exit (2);
     }
   else if (level == GPGRT_LOGLVL_BUG)
     {
-      if (missing_lf)
-        _gpgrt_putc_unlocked ('\n', logstream );
       run_post_log_funcs (level);
       _gpgrt_funlockfile (logstream);
       /* Using backtrace requires a configure test and to pass
@@ -1076,6 +2860,11 @@ _gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
   else
     _gpgrt_funlockfile (logstream);
 
+#ifdef USE_ASYNC_LOG
+ leave:
+#endif
+  rec_release (&rec);
+
   /* Bumb the error counter for log_error.  */
   if (level == GPGRT_LOGLVL_ERROR)
     _gpgrt_inc_errorcount ();
@@ -1084,6 +2873,16 @@ _gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
 }
 
 
+/* Exported so that we can use it in visibility.c.  */
+int
+_gpgrt_logv_internal (int level, int ignore_arg_ptr, const char *extrastring,
+                      const char *prefmt, const char *fmt, va_list arg_ptr)
+{
+  return logv_internal (level, ignore_arg_ptr, 0,
+                        extrastring, prefmt, fmt, arg_ptr);
+}
+
+
 void
 _gpgrt_log (int level, const char *fmt, ...)
 {
@@ -1192,6 +2991,20 @@ _gpgrt_log_debug (const char *fmt, ...)
 }
 
 
+/* The same as log_debug but not subject to the rate limit.  This is
+ * used for the lines of the library's own multi-line output which
+ * all use the same format string.  */
+void
+_gpgrt_log_debug_nolimit (const char *fmt, ...)
+{
+  va_list arg_ptr;
+
+  va_start (arg_ptr, fmt);
+  logv_internal (GPGRT_LOGLVL_DEBUG, 0, 1, NULL, NULL, fmt, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
 /* The same as log_debug but at the end of the output STRING is
  * printed with LFs expanded to include the prefix and a final --end--
  * marker.  */
@@ -1219,11 +3032,15 @@ _gpgrt_log_printf (const char *fmt, ...)
 
 
 /* Flush the log - this is useful to make sure that the trailing
-   linefeed has been printed.  */
+   linefeed has been printed.  In async mode this also waits until
+   the writer thread has written all queued records.  */
 void
 _gpgrt_log_flush (void)
 {
   do_log_ignore_arg (GPGRT_LOGLVL_CONT, NULL);
+#ifdef USE_ASYNC_LOG
+  async_drain ();
+#endif
 }
 
 
@@ -1236,11 +3053,14 @@ void
 _gpgrt_logv_printhex (const void *buffer, size_t length,
                       const char *fmt, va_list arg_ptr)
 {
+  static const char hexdigits[] = "0123456789abcdef";
   int wrap = 0;
   int wrapamount = 0;
   int cnt = 0;
   const unsigned char *p;
   int trunc = 0;  /* Only print a shortened string.  */
+  char line[1 + 2*32 + 4 + 1];  /* Hex of up to 32 bytes, a suffix and nul.  */
+  size_t n = 0;
 
   /* FIXME: This printing is not yet protected by _gpgrt_flockfile.  */
   if (fmt && *fmt)
@@ -1262,32 +3082,55 @@ _gpgrt_logv_printhex (const void *buffer, size_t length,
       wrap = 1;
     }
 
+  if (!_gpgrt_log_level_p (GPGRT_LOGLVL_CONT))
+    return;  /* Don't waste time on a suppressed dump.  */
+
+  /* The hex digits are collected in LINE so that each output line
+   * is logged as one record and not byte by byte.  LINE is logged
+   * verbatim and not as a "%s" argument to avoid escaping.  */
   if (length)
     {
       if (wrap)
-        _gpgrt_log_printf (" ");
+        line[n++] = ' ';
 
       for (p = buffer; length--; p++)
         {
-          _gpgrt_log_printf ("%02x", *p);
+          line[n++] = hexdigits[(*p >> 4) & 15];
+          line[n++] = hexdigits[*p & 15];
           if (wrap && ++cnt == 32 && length)
             {
               if (trunc)
                 {
-                  _gpgrt_log_printf (" …");
+                  memcpy (line + n, " …", 4);
+                  n += 4;
                   break;
                 }
 
               cnt = 0;
               /* (we indicate continuations with a backslash) */
-              _gpgrt_log_printf (" \\\n");
+              memcpy (line + n, " \\\n", 3);
+              n += 3;
+              line[n] = 0;
+              do_log_ignore_arg (GPGRT_LOGLVL_CONT, line);
+              n = 0;
               if (wrap)
-                _gpgrt_log_debug ("%*s", wrapamount, "");
+                _gpgrt_log_debug_nolimit ("%*s", wrapamount, "");
               else
-                _gpgrt_log_debug ("%s", "");
+                _gpgrt_log_debug_nolimit ("%s", "");
               if (fmt && *fmt)
-                _gpgrt_log_printf (" ");
+                line[n++] = ' ';
             }
+          else if (n >= 2*32)
+            {
+              line[n] = 0;
+              do_log_ignore_arg (GPGRT_LOGLVL_CONT, line);
+              n = 0;
+            }
+        }
+      if (n)
+        {
+          line[n] = 0;
+          do_log_ignore_arg (GPGRT_LOGLVL_CONT, line);
         }
     }
 
@@ -23,12 +23,58 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if USE_POSIX_THREADS && !USE_POSIX_THREADS_WEAK
+# include <pthread.h>
+# define USE_PARSE_THREADS 1
+#endif
 
 #include "gpgrt-int.h"
 
 
+/* Containers with at least this number of named entries get a hash
+ * index for the lookup by name.  */
+#define NVC_INDEX_THRESHOLD 16
+
+/* The default and the maximum number of threads used to parse files
+ * by _gpgrt_nvc_parse_files.  */
+#define PARSE_DEFAULT_THREADS 4
+#define PARSE_MAX_THREADS    16
+
+/* The size of the blocks of an arena and the alignment used for
+ * allocations from the arena.  Larger objects get their own block.  */
+#define ARENA_BLOCKSIZE 4096
+#define ARENA_ALIGN     8
+
+/* A block of memory of an arena.  */
+struct arena_block_s
+{
+  struct arena_block_s *next;
+  size_t size;  /* Size of the data area.  */
+  size_t used;  /* Used bytes of the data area.  */
+};
+
+/* Size of the header of a block rounded up to ARENA_ALIGN.  */
+#define ARENA_HDRSIZE ((sizeof (struct arena_block_s) + ARENA_ALIGN - 1) \
+                       & ~(size_t)(ARENA_ALIGN - 1))
+
+/* In arena mode all entries and strings of a container are allocated
+ * from a list of blocks; they are released all at once.  */
+struct nvc_arena_s
+{
+  struct arena_block_s *blocks;  /* The first block is the current.  */
+};
+
+
 struct _gpgrt_name_value_container
 {
   struct _gpgrt_name_value_entry *first;
@@ -37,6 +83,21 @@ struct _gpgrt_name_value_container
   unsigned int private_key_mode:1;
   unsigned int section_mode:1;
   unsigned int modified:1;
+
+  /* The number of entries with a name.  */
+  unsigned int nnamed;
+
+  /* The arena for the entries or NULL.  */
+  struct nvc_arena_s *arena;
+
+  /* The optional hash index.  Each bucket is a list of the first
+   * entries with a certain name linked by HNEXT.  INDEXSIZE is a
+   * power of 2 and NHEADS the number of distinct names.  The index
+   * is created by do_nvc_add when NNAMED reaches NVC_INDEX_THRESHOLD
+   * so that lookups never modify the container.  */
+  struct _gpgrt_name_value_entry **index;
+  unsigned int indexsize;
+  unsigned int nheads;
 };
 
 
@@ -46,6 +107,10 @@ struct _gpgrt_name_value_entry
   struct _gpgrt_name_value_entry *next;
 
   unsigned int wipe_on_free:1;  /* Copied from the container.  */
+  unsigned int implicit_raw:1;  /* The raw value is " VALUE\n".  */
+
+  /* The arena of the container or NULL.  */
+  struct nvc_arena_s *arena;
 
   /* The length of the NAME (to save calling strlen).  */
   unsigned int namelen:8;
@@ -59,6 +124,14 @@ struct _gpgrt_name_value_entry
 
   /* The decoded value.  */
   char *value;
+
+  /* Only used if the container has an index: HNEXT links the first
+   * entries of the names in a bucket.  NEXTSAME and PREVSAME link all
+   * entries with the same name in file order; PREVSAME of the first
+   * entry points to the last one.  */
+  struct _gpgrt_name_value_entry *hnext;
+  struct _gpgrt_name_value_entry *nextsame;
+  struct _gpgrt_name_value_entry *prevsame;
 };
 
 
@@ -132,6 +205,299 @@ same_name_p (const char *name, size_t namelen, const char *string)
 
 
 
+/* Allocate N bytes from ARENA.  If ARENA is NULL the memory is
+ * allocated from the heap.  Returns NULL and sets ERRNO on error.  */
+static void *
+arena_alloc (struct nvc_arena_s *arena, size_t n)
+{
+  struct arena_block_s *blk;
+  size_t size;
+
+  if (!arena)
+    return xtrymalloc (n);
+
+  n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  blk = arena->blocks;
+  if (!blk || n > blk->size - blk->used)
+    {
+      size = n > ARENA_BLOCKSIZE / 4? n : ARENA_BLOCKSIZE - ARENA_HDRSIZE;
+      blk = xtrymalloc (ARENA_HDRSIZE + size);
+      if (!blk)
+        return NULL;
+      blk->size = size;
+      blk->used = 0;
+      if (n > ARENA_BLOCKSIZE / 4 && arena->blocks)
+        {
+          /* Keep on using the current block for small objects.  */
+          blk->next = arena->blocks->next;
+          arena->blocks->next = blk;
+        }
+      else
+        {
+          blk->next = arena->blocks;
+          arena->blocks = blk;
+        }
+    }
+
+  blk->used += n;
+  return (char *)blk + ARENA_HDRSIZE + blk->used - n;
+}
+
+
+/* Same as arena_alloc but clears the memory.  */
+static void *
+arena_calloc (struct nvc_arena_s *arena, size_t n)
+{
+  void *p;
+
+  if (!arena)
+    return xtrycalloc (1, n);
+  p = arena_alloc (arena, n);
+  if (p)
+    memset (p, 0, n);
+  return p;
+}
+
+
+static char *
+arena_strdup (struct nvc_arena_s *arena, const char *string)
+{
+  size_t n = strlen (string);
+  char *p;
+
+  p = arena_alloc (arena, n + 1);
+  if (p)
+    memcpy (p, string, n + 1);
+  return p;
+}
+
+
+/* Release P if it has not been allocated from ARENA.  Memory from an
+ * arena is only released with the entire arena.  */
+static void
+arena_free (struct nvc_arena_s *arena, void *p)
+{
+  if (!arena)
+    xfree (p);
+}
+
+
+/* Release ARENA and all its memory which is wiped if WIPE is set.  */
+static void
+arena_release (struct nvc_arena_s *arena, int wipe)
+{
+  struct arena_block_s *blk, *next;
+
+  if (!arena)
+    return;
+  for (blk = arena->blocks; blk; blk = next)
+    {
+      next = blk->next;
+      if (wipe)
+        _gpgrt_wipememory ((char *)blk + ARENA_HDRSIZE, blk->used);
+      xfree (blk);
+    }
+  xfree (arena);
+}
+
+
+/* Append STRING to the raw value list at R_LIST using ARENA.  R_TAIL
+ * holds the last item of the list or NULL and is updated.  WIPE
+ * requests that the string is wiped on release.  Returns the new
+ * item or NULL on error.  */
+static gpgrt_strlist_t
+raw_append (struct nvc_arena_s *arena, gpgrt_strlist_t *r_list,
+            gpgrt_strlist_t *r_tail, const char *string, int wipe)
+{
+  gpgrt_strlist_t sl;
+  size_t n;
+
+  if (!arena)
+    return _gpgrt_strlist_append (r_list, r_tail, string,
+                                  wipe? GPGRT_STRLIST_WIPE : 0);
+
+  n = strlen (string);
+  sl = arena_alloc (arena, sizeof *sl + n);
+  if (!sl)
+    return NULL;
+  sl->next = NULL;
+  sl->flags = 0;
+  sl->_private_flags = 0;
+  memcpy (sl->d, string, n + 1);
+  if (*r_tail)
+    (*r_tail)->next = sl;
+  else
+    *r_list = sl;
+  *r_tail = sl;
+  return sl;
+}
+
+
+/* Release the raw value LIST allocated from ARENA.  */
+static void
+raw_release (struct nvc_arena_s *arena, gpgrt_strlist_t list, int wipe)
+{
+  if (!arena)
+    _gpgrt_strlist_free (list);
+  else if (wipe)
+    for (; list; list = list->next)
+      _gpgrt_wipememory (list->d, strlen (list->d));
+}
+
+
+/* Return the case-folded hash value of NAME with length NAMELEN.  */
+static unsigned int
+name_hash (const char *name, size_t namelen)
+{
+  unsigned int h = 2166136261u;  /* FNV-1a */
+
+  for (; namelen; namelen--, name++)
+    {
+      h ^= (unsigned char)ascii_toupper (*name);
+      h *= 16777619u;
+    }
+  return h;
+}
+
+
+/* Return the first entry of the name (NAME,NAMELEN) from the index of
+ * CONT or NULL if there is no such entry.  */
+static struct _gpgrt_name_value_entry *
+index_find (gpgrt_nvc_t cont, const char *name, size_t namelen)
+{
+  struct _gpgrt_name_value_entry *e;
+
+  e = cont->index[name_hash (name, namelen) & (cont->indexsize - 1)];
+  for (; e; e = e->hnext)
+    if (e->namelen == namelen && !ascii_memcasecmp (e->name, name, namelen))
+      return e;
+  return NULL;
+}
+
+
+/* Double the size of the index of CONT.  On error the old index is
+ * kept.  */
+static void
+index_grow (gpgrt_nvc_t cont)
+{
+  struct _gpgrt_name_value_entry **newindex, *e, *next;
+  unsigned int newsize = 2 * cont->indexsize;
+  unsigned int i, idx;
+
+  newindex = xtrycalloc (newsize, sizeof *newindex);
+  if (!newindex)
+    return;
+  for (i=0; i < cont->indexsize; i++)
+    for (e = cont->index[i]; e; e = next)
+      {
+        next = e->hnext;
+        idx = name_hash (e->name, e->namelen) & (newsize - 1);
+        e->hnext = newindex[idx];
+        newindex[idx] = e;
+      }
+  xfree (cont->index);
+  cont->index = newindex;
+  cont->indexsize = newsize;
+}
+
+
+/* Insert the named entry E into the index of CONT.  AFTER is the
+ * entry with the same name which precedes E in the file or NULL if E
+ * is the last entry with its name.  */
+static void
+index_insert (gpgrt_nvc_t cont, struct _gpgrt_name_value_entry *e,
+              struct _gpgrt_name_value_entry *after)
+{
+  struct _gpgrt_name_value_entry *head;
+  unsigned int idx;
+
+  head = index_find (cont, e->name, e->namelen);
+  if (!head)
+    {
+      idx = name_hash (e->name, e->namelen) & (cont->indexsize - 1);
+      e->hnext = cont->index[idx];
+      cont->index[idx] = e;
+      e->nextsame = NULL;
+      e->prevsame = e;
+      if (++cont->nheads > cont->indexsize)
+        index_grow (cont);
+      return;
+    }
+
+  if (!after)
+    after = head->prevsame;
+  e->hnext = NULL;
+  e->prevsame = after;
+  e->nextsame = after->nextsame;
+  if (after->nextsame)
+    after->nextsame->prevsame = e;
+  else
+    head->prevsame = e;
+  after->nextsame = e;
+}
+
+
+/* Remove the named entry E from the index of CONT.  */
+static void
+index_remove (gpgrt_nvc_t cont, struct _gpgrt_name_value_entry *e)
+{
+  struct _gpgrt_name_value_entry *head, **ep;
+
+  head = index_find (cont, e->name, e->namelen);
+  if (!head)
+    return;  /* Can't happen.  */
+
+  if (head != e)
+    {
+      e->prevsame->nextsame = e->nextsame;
+      if (e->nextsame)
+        e->nextsame->prevsame = e->prevsame;
+      else
+        head->prevsame = e->prevsame;
+      return;
+    }
+
+  /* E is the first entry of its name; the next one takes its place
+   * in the bucket.  */
+  ep = &cont->index[name_hash (e->name, e->namelen) & (cont->indexsize - 1)];
+  for (; *ep != e; ep = &(*ep)->hnext)
+    ;
+  if (e->nextsame)
+    {
+      e->nextsame->prevsame = e->prevsame;
+      e->nextsame->hnext = e->hnext;
+      *ep = e->nextsame;
+    }
+  else
+    {
+      *ep = e->hnext;
+      cont->nheads--;
+    }
+}
+
+
+/* Create the index for CONT.  On error CONT is used without an
+ * index.  */
+static void
+index_build (gpgrt_nvc_t cont)
+{
+  struct _gpgrt_name_value_entry *e;
+  unsigned int size;
+
+  for (size = 32; size < cont->nnamed; size *= 2)
+    ;
+  cont->index = xtrycalloc (size, sizeof *cont->index);
+  if (!cont->index)
+    return;
+  cont->indexsize = size;
+  cont->nheads = 0;
+  for (e = cont->first; e; e = e->next)
+    if (e->name)
+      index_insert (cont, e, NULL);
+}
+
+
+
 /* Allocate a name value container structure.  */
 gpgrt_nvc_t
 _gpgrt_nvc_new (unsigned int flags)
@@ -150,6 +516,15 @@ _gpgrt_nvc_new (unsigned int flags)
   else if ((flags & GPGRT_NVC_WIPE))
     nvc->wipe_on_free     = 1;
   nvc->section_mode = !!(flags & GPGRT_NVC_SECTION);
+  if ((flags & GPGRT_NVC_ARENA))
+    {
+      nvc->arena = xtrycalloc (1, sizeof *nvc->arena);
+      if (!nvc->arena)
+        {
+          xfree (nvc);
+          return NULL;
+        }
+    }
 
   return nvc;
 }
@@ -162,9 +537,14 @@ nve_release (gpgrt_nve_t entry, int with_wipe)
   if (!entry)
     return;
 
-  xfree (entry->name);
   if (entry->value && with_wipe)
     _gpgrt_wipememory (entry->value, strlen (entry->value));
+  if (entry->arena)
+    {
+      raw_release (entry->arena, entry->raw_value, with_wipe);
+      return;  /* The memory is released with the arena.  */
+    }
+  xfree (entry->name);
   xfree (entry->value);
   _gpgrt_strlist_free (entry->raw_value);
   xfree (entry);
@@ -180,12 +560,21 @@ _gpgrt_nvc_release (gpgrt_nvc_t cont)
   if (!cont)
     return;
 
-  for (e = cont->first; e; e = next)
+  if (cont->arena)
+    {
+      /* All entries are in the arena.  */
+      arena_release (cont->arena, cont->wipe_on_free);
+    }
+  else
     {
-      next = e->next;
-      nve_release (e, cont->wipe_on_free);
+      for (e = cont->first; e; e = next)
+        {
+          next = e->next;
+          nve_release (e, cont->wipe_on_free);
+        }
     }
 
+  xfree (cont->index);
   xfree (cont);
 }
 
@@ -213,6 +602,8 @@ _gpgrt_nvc_get_flag (gpgrt_nvc_t cont, unsigned int flags, int clear)
     ret = cont->wipe_on_free;
   else if ((flags & GPGRT_NVC_SECTION))
     ret = cont->section_mode;
+  else if ((flags & GPGRT_NVC_ARENA))
+    ret = !!cont->arena;
 
   return !!ret;
 }
@@ -264,6 +655,7 @@ static gpg_err_code_t
 assert_raw_value (gpgrt_nve_t entry)
 {
   gpg_err_code_t err = 0;
+  gpgrt_strlist_t tail = NULL;
   size_t len, offset;
 #define LINELEN	70
   char buf[LINELEN+3];
@@ -307,9 +699,8 @@ assert_raw_value (gpgrt_nve_t entry)
 
       snprintf (buf, sizeof buf, " %.*s\n", (int) amount,
 		&entry->value[offset]);
-      if (!_gpgrt_strlist_add (&entry->raw_value, buf,
-                               (GPGRT_STRLIST_APPEND
-                                | (entry->wipe_on_free? GPGRT_STRLIST_WIPE:0))))
+      if (!raw_append (entry->arena, &entry->raw_value, &tail, buf,
+                       entry->wipe_on_free))
 	{
 	  err = _gpg_err_code_from_syserror ();
 	  goto leave;
@@ -322,7 +713,7 @@ assert_raw_value (gpgrt_nve_t entry)
  leave:
   if (err)
     {
-      _gpgrt_strlist_free (entry->raw_value);
+      raw_release (entry->arena, entry->raw_value, entry->wipe_on_free);
       entry->raw_value = NULL;
     }
 
@@ -397,7 +788,7 @@ assert_value (gpgrt_nve_t entry)
   /* Add one for the terminating zero.  */
   len += 1;
 
-  entry->value = p = xtrymalloc (len);
+  entry->value = p = arena_alloc (entry->arena, len);
   if (!entry->value)
     return _gpg_err_code_from_syserror ();
 
@@ -449,6 +840,7 @@ do_nvc_add (gpgrt_nvc_t cont, char *name, char *value,
 {
   gpg_err_code_t err = 0;
   gpgrt_nve_t e;
+  gpgrt_nve_t samename = NULL;
   unsigned int namelen;
 
   gpgrt_assert (value || raw_value);
@@ -469,13 +861,14 @@ do_nvc_add (gpgrt_nvc_t cont, char *name, char *value,
       goto leave;
     }
 
-  e = xtrycalloc (1, sizeof *e);
+  e = arena_calloc (cont->arena, sizeof *e);
   if (!e)
     {
       err = _gpg_err_code_from_syserror ();
       goto leave;
     }
 
+  e->arena = cont->arena;
   e->name = name;
   e->namelen = namelen;
   e->value = value;
@@ -506,6 +899,7 @@ do_nvc_add (gpgrt_nvc_t cont, char *name, char *value,
                   else
                     break;
                 }
+              samename = last;
             }
 	  else /* Otherwise, just find the last entry.  */
 	    last = cont->last;
@@ -528,16 +922,24 @@ do_nvc_add (gpgrt_nvc_t cont, char *name, char *value,
   else
     cont->first = cont->last = e;
 
+  if (name)
+    {
+      cont->nnamed++;
+      if (cont->index)
+        index_insert (cont, e, samename);
+      else if (cont->nnamed >= NVC_INDEX_THRESHOLD)
+        index_build (cont);
+    }
   cont->modified = 1;
 
  leave:
   if (err)
     {
-      xfree (name);
+      arena_free (cont->arena, name);
       if (value && cont->wipe_on_free)
 	_gpgrt_wipememory (value, strlen (value));
-      xfree (value);
-      _gpgrt_strlist_free (raw_value);
+      arena_free (cont->arena, value);
+      raw_release (cont->arena, raw_value, cont->wipe_on_free);
     }
 
   return err;
@@ -551,14 +953,14 @@ _gpgrt_nvc_add (gpgrt_nvc_t cont, const char *name, const char *value)
 {
   char *k, *v;
 
-  k = xtrystrdup (name);
+  k = arena_strdup (cont->arena, name);
   if (!k)
     return _gpg_err_code_from_syserror ();
 
-  v = xtrystrdup (value);
+  v = arena_strdup (cont->arena, value);
   if (!v)
     {
-      xfree (k);
+      arena_free (cont->arena, k);
       return _gpg_err_code_from_syserror ();
     }
 
@@ -602,15 +1004,16 @@ _gpgrt_nve_set (gpgrt_nvc_t cont, gpgrt_nve_t e, const char *value)
       return 0;
     }
 
-  v = xtrystrdup (value? value:"");
+  v = arena_strdup (e->arena, value? value:"");
   if (!v)
     return _gpg_err_code_from_syserror ();
 
-  _gpgrt_strlist_free (e->raw_value);
+  raw_release (e->arena, e->raw_value, e->wipe_on_free);
   e->raw_value = NULL;
+  e->implicit_raw = 0;
   if (e->value)
     _gpgrt_wipememory (e->value, strlen (e->value));
-  xfree (e->value);
+  arena_free (e->arena, e->value);
   e->value = v;
   if (cont)
     cont->modified = 1;
@@ -623,6 +1026,13 @@ _gpgrt_nve_set (gpgrt_nvc_t cont, gpgrt_nve_t e, const char *value)
 static void
 do_nvc_delete (gpgrt_nvc_t cont, gpgrt_nve_t entry)
 {
+  if (entry->name)
+    {
+      if (cont->index)
+        index_remove (cont, entry);
+      cont->nnamed--;
+    }
+
   if (entry->prev)
     entry->prev->next = entry->next;
   else
@@ -677,6 +1087,15 @@ _gpgrt_nvc_lookup (gpgrt_nvc_t cont, const char *name)
       return NULL;
     }
 
+  if (cont->index)
+    {
+      size_t namelen = strlen (name);
+
+      if (namelen && name[namelen-1] == ':')
+        namelen--;
+      return index_find (cont, name, namelen);
+    }
+
   for (entry = cont->first; entry; entry = entry->next)
     if (entry->name && same_name_p (entry->name, entry->namelen, name))
       return entry;
@@ -693,6 +1112,11 @@ _gpgrt_nve_next (gpgrt_nve_t entry, const char *name)
   if (!entry)
     return NULL;
 
+  /* With an index the entries of the same name are linked.  */
+  if (name && entry->prevsame
+      && same_name_p (entry->name, entry->namelen, name))
+    return entry->nextsame;
+
   if (name)
     {
       for (entry = entry->next; entry; entry = entry->next)
@@ -712,195 +1136,457 @@ _gpgrt_nve_next (gpgrt_nve_t entry, const char *name)
 
 /* Parsing and serialization.  */
 
+/* State of the parser.  */
+struct parse_state_s
+{
+  gpgrt_nvc_t cont;              /* The container being built.  */
+  struct nvc_arena_s *arena;     /* Its arena or NULL.  */
+  unsigned int flags;            /* The flags used to create CONT.  */
+  int wipe;                      /* Wipe the raw lines on release.  */
+  char *name;                    /* The name of the pending entry.  */
+  char *section;                 /* The current section or NULL.  */
+  gpgrt_strlist_t raw_value;     /* The raw lines of the pending entry.  */
+  gpgrt_strlist_t raw_tail;      /* The last item of RAW_VALUE.  */
+};
+
+
+/* Add the pending entry of the parser state PS to the container.  */
 static gpg_err_code_t
-do_nvc_parse (gpgrt_nvc_t *result, int *errlinep, estream_t stream,
-              unsigned int flags)
+parse_flush (struct parse_state_s *ps)
 {
   gpg_err_code_t err = 0;
-  gpgrt_ssize_t len;
-  char *buf = NULL;
-  size_t buf_len = 0;
-  char *name = NULL;
-  char *section = NULL;
-  gpgrt_strlist_t raw_value = NULL;
-  unsigned int slflags;
 
-  *result = _gpgrt_nvc_new (flags);
-  if (!*result)
-    return _gpg_err_code_from_syserror ();
+  if (ps->raw_value)
+    {
+      err = do_nvc_add (ps->cont, ps->name, NULL,
+                        ps->raw_value, 1 /*preserve order*/);
+      ps->name = NULL;
+    }
+  ps->raw_value = NULL;
+  ps->raw_tail = NULL;
+  return err;
+}
 
-  slflags = (GPGRT_STRLIST_APPEND
-             | ((flags & GPGRT_NVC_WIPE)? GPGRT_STRLIST_WIPE:0));
 
-  if (errlinep)
-    *errlinep = 0;
-  while ((len = _gpgrt_read_line (stream, &buf, &buf_len, NULL)) > 0)
+/* Parse the line BUF which is modified by this function.  If INPLACE
+ * is set, BUF has been allocated from the arena of the container and
+ * the name and a simple value may directly be taken from it; this
+ * requires that the caller has checked that the next line is not a
+ * continuation.  */
+static gpg_err_code_t
+parse_line (struct parse_state_s *ps, char *buf, int inplace)
+{
+  gpg_err_code_t err;
+  char *p, *p2;
+
+  /* Skip any whitespace.  */
+  for (p = buf; *p && ascii_isspace (*p); p++)
+    /* Do nothing.  */;
+
+  if (ps->name && (spacep (buf) || !*p))
     {
-      char *p, *p2;
+      /* A continuation.  */
+      if (!raw_append (ps->arena, &ps->raw_value, &ps->raw_tail,
+                       buf, ps->wipe))
+        return _gpg_err_code_from_syserror ();
+      return 0;
+    }
 
-      if (errlinep)
-	*errlinep += 1;
+  /* No continuation.  Add the current entry if any.  */
+  err = parse_flush (ps);
+  if (err)
+    return err;
 
-      /* Skip any whitespace.  */
-      for (p = buf; *p && ascii_isspace (*p); p++)
-	/* Do nothing.  */;
+  if ((ps->flags & GPGRT_NVC_SECTION) && *p == '[' && (p2=strchr (p+1, ']')))
+    {
+      /* This is a section header.  Extract it so that we can
+       * prepend all names with it.  We allow a comment after the
+       * section and spaces after the [ and before the ].  No
+       * spaces inside the section name.  We also limit the name
+       * to 200 characters. */
+      _gpgrt_trim_spaces (p2+1);
+      if (p == p2 || (p2[1] && p2[1] != '#'))
+        return GPG_ERR_INV_VALUE;
+      *p2 = 0;
+      p++;
+      _gpgrt_trim_spaces (p);
+      if (!*p || strpbrk (p, " \t#:") || strlen (p) > 200)
+        return GPG_ERR_INV_VALUE;  /* No or invalid section name */
+      xfree (ps->section);
+      ps->section = xtrystrdup (p);
+      if (!ps->section)
+        return _gpg_err_code_from_syserror ();
+      /* Map all backslashes to slashes.  */
+      for (p2=ps->section; *p2; p2++)
+        if (*p2 == '\\')
+          *p2 = '/';
 
-      if (name && (spacep (buf) || !*p))
-	{
-	  /* A continuation.  */
-	  if (!_gpgrt_strlist_add (&raw_value, buf, slflags))
-	    {
-	      err = _gpg_err_code_from_syserror ();
-	      goto leave;
-	    }
-	  continue;
-	}
+      return 0;
+    }
 
-      /* No continuation.  Add the current entry if any.  */
-      if (raw_value)
-	{
-	  err = do_nvc_add (*result, name, NULL,
-                            raw_value, 1 /*preserve order*/);
-          name = NULL;
-	  if (err)
-	    goto leave;
-	}
 
-      /* And prepare for the next one.  */
-      name = NULL;
-      raw_value = NULL;
+  if (*p && *p != '#')
+    {
+      char *colon, *value, tmp;
+      size_t n;
 
-      if ((flags & GPGRT_NVC_SECTION) && *p == '[' && (p2=strchr (p+1, ']')))
+      colon = strchr (buf, ':');
+      if (!colon)
+        return GPG_ERR_INV_VALUE;
+      value = colon + 1;
+
+      if (inplace && !ps->section && *value == ' ')
         {
-          /* This is a section header.  Extract it so that we can
-           * prepend all names with it.  We allow a comment after the
-           * section and spaces after the [ and before the ].  No
-           * spaces inside the section name.  We also limit the name
-           * to 200 characters. */
-          _gpgrt_trim_spaces (p2+1);
-          if (p == p2 || (p2[1] && p2[1] != '#'))
-            {
-              err = GPG_ERR_INV_VALUE;
-	      goto leave;
-            }
-          *p2 = 0;
-          p++;
-          _gpgrt_trim_spaces (p);
-          if (!*p || strpbrk (p, " \t#:") || strlen (p) > 200)
+          /* Fast path for the common case of a "NAME: VALUE\n" line
+           * where VALUE has no trailing white space.  The raw value
+           * can be derived from the value and thus both, the name
+           * and the value, are taken from the line.  */
+          n = strlen (value + 1);
+          if (n > 1 && value[n] == '\n' && !ascii_isspace (value[n-1]))
             {
-              err = GPG_ERR_INV_VALUE;  /* No or invalid section name */
-	      goto leave;
+              value[n] = 0;
+              *value = 0;
+              err = do_nvc_add (ps->cont, p, value + 1, NULL, 1);
+              if (!err)
+                ps->cont->last->implicit_raw = 1;
+              return err;
             }
-          xfree (section);
-          section = xtrystrdup (p);
-          if (!section)
-            {
-	      err = _gpg_err_code_from_syserror ();
-	      goto leave;
-	    }
-          /* Map all backslashes to slashes.  */
-          for (p2=section; *p2; p2++)
-            if (*p2 == '\\')
-              *p2 = '/';
+        }
 
-          continue;
+      if (!raw_append (ps->arena, &ps->raw_value, &ps->raw_tail,
+                       value, ps->wipe))
+        return _gpg_err_code_from_syserror ();
+
+      tmp = *value;
+      *value = 0;
+      if (ps->section)
+        {
+          ps->name = arena_alloc (ps->arena,
+                                  strlen (ps->section) + strlen (p) + 2);
+          if (ps->name)
+            strcpy (stpcpy (stpcpy (ps->name, ps->section), ":"), p);
         }
+      else if (inplace)
+        ps->name = p;  /* The raw value has already been copied.  */
+      else
+        ps->name = arena_strdup (ps->arena, p);
+      if (!inplace)
+        *value = tmp;
+      if (!ps->name)
+        return _gpg_err_code_from_syserror ();
+      return 0;
+    }
 
+  if (!raw_append (ps->arena, &ps->raw_value, &ps->raw_tail,
+                   buf, ps->wipe))
+    return _gpg_err_code_from_syserror ();
+  return 0;
+}
 
-      if (*p && *p != '#')
-	{
-	  char *colon, *value, tmp;
 
-	  colon = strchr (buf, ':');
-	  if (!colon)
-	    {
-	      err = GPG_ERR_INV_VALUE;
-	      goto leave;
-	    }
+/* Create a new container for the parser state PS.  */
+static gpg_err_code_t
+parse_init (struct parse_state_s *ps, unsigned int flags)
+{
+  memset (ps, 0, sizeof *ps);
+  ps->cont = _gpgrt_nvc_new (flags);
+  if (!ps->cont)
+    return _gpg_err_code_from_syserror ();
+  ps->arena = ps->cont->arena;
+  ps->flags = flags;
+  ps->wipe = !!(flags & GPGRT_NVC_WIPE);
+  return 0;
+}
 
-	  value = colon + 1;
-	  tmp = *value;
-	  *value = 0;
-          if (section)
-            name = _gpgrt_strconcat (section, ":", p, NULL);
-          else
-            name = xtrystrdup (p);
-	  *value = tmp;
-	  if (!name)
-	    {
-	      err = _gpg_err_code_from_syserror ();
-	      goto leave;
-	    }
 
-	  if (!_gpgrt_strlist_add (&raw_value, value, slflags))
-	    {
-	      err = _gpg_err_code_from_syserror ();
-	      goto leave;
-	    }
-	  continue;
-	}
+/* Finish parsing, release the parser state PS and store the container
+ * at RESULT unless ERR is set.  */
+static gpg_err_code_t
+parse_finish (struct parse_state_s *ps, gpg_err_code_t err,
+              gpgrt_nvc_t *result)
+{
+  /* Add the final entry.  */
+  if (!err)
+    err = parse_flush (ps);
 
-      if (!_gpgrt_strlist_add (&raw_value, buf, slflags))
-	{
-	  err = _gpg_err_code_from_syserror ();
-	  goto leave;
-	}
+  xfree (ps->section);
+  arena_free (ps->arena, ps->name);
+  raw_release (ps->arena, ps->raw_value, ps->wipe);
+  if (err)
+    {
+      _gpgrt_nvc_release (ps->cont);
+      *result = NULL;
+    }
+  else
+    *result = ps->cont;
+
+  return err;
+}
+
+
+static gpg_err_code_t
+do_nvc_parse (gpgrt_nvc_t *result, int *errlinep, estream_t stream,
+              unsigned int flags)
+{
+  gpg_err_code_t err = 0;
+  struct parse_state_s ps;
+  gpgrt_ssize_t len;
+  char *buf = NULL;
+  size_t buf_len = 0;
+
+  *result = NULL;
+  err = parse_init (&ps, flags);
+  if (err)
+    return err;
+
+  if (errlinep)
+    *errlinep = 0;
+  while ((len = _gpgrt_read_line (stream, &buf, &buf_len, NULL)) > 0)
+    {
+      if (errlinep)
+	*errlinep += 1;
+
+      err = parse_line (&ps, buf, 0);
+      if (err)
+        goto leave;
     }
   if (len < 0)
+    err = _gpg_err_code_from_syserror ();
+
+ leave:
+  xfree (buf);
+  return parse_finish (&ps, err, result);
+}
+
+
+/* Parse STREAM and return a newly allocated name value container
+   structure in RESULT.  If ERRLINEP is given, the line number the
+   parser was last considering is stored there.  */
+gpg_err_code_t
+_gpgrt_nvc_parse (gpgrt_nvc_t *result, int *errlinep, estream_t stream,
+                  unsigned int flags)
+{
+  return do_nvc_parse (result, errlinep, stream, flags);
+}
+
+
+/* Return true if the line at S of the copied document is a
+ * continuation line; that is it starts with a space or it is empty.  */
+static int
+continuation_line_p (const char *s)
+{
+  if (spacep (s))
+    return 1;
+  for (; *s && ascii_isspace (*s); s++)
+    ;
+  return !*s;
+}
+
+
+/* Parse the LENGTH bytes at BUFFER and return a newly allocated name
+ * value container in RESULT.  This is the same as _gpgrt_nvc_parse
+ * but the container is always allocated with GPGRT_NVC_ARENA.  The
+ * document is copied once into the arena with each line terminated
+ * by a Nul so that names and simple values can be used directly.
+ * Unlike with _gpgrt_nvc_parse the container is not marked as
+ * modified.  If ERRLINEP is given, the line number the parser was
+ * last considering is stored there.  */
+gpg_err_code_t
+_gpgrt_nvc_parse_mem (gpgrt_nvc_t *result, int *errlinep,
+                      const void *buffer, size_t length, unsigned int flags)
+{
+  gpg_err_code_t err;
+  struct parse_state_s ps;
+  const char *src = buffer;
+  const char *end = src + length;
+  const char *s, *nl;
+  char *copy, *cend, *line, *next, *p;
+  size_t nlines, n;
+
+  *result = NULL;
+  err = parse_init (&ps, flags | GPGRT_NVC_ARENA);
+  if (err)
+    return err;
+
+  /* Count the lines to allocate the copy.  */
+  for (nlines = 1, s = src; (nl = memchr (s, '\n', end - s)); s = nl + 1)
+    nlines++;
+  copy = arena_alloc (ps.arena, length + nlines);
+  if (!copy)
     {
       err = _gpg_err_code_from_syserror ();
       goto leave;
     }
 
-  /* Add the final entry.  */
-  if (raw_value)
+  /* Copy the lines and terminate each by a Nul.  Note that we want
+   * to keep the linefeed to have the same raw lines as the stream
+   * based parser.  */
+  for (next = copy, s = src; s < end; s += n)
     {
-      err = do_nvc_add (*result, name, NULL, raw_value, 1 /*preserve order*/);
-      name = NULL;
+      nl = memchr (s, '\n', end - s);
+      n = nl? (nl + 1 - s) : (end - s);
+      memcpy (next, s, n);
+      next += n;
+      *next++ = 0;
     }
+  cend = next;
 
- leave:
-  xfree (section);
-  xfree (name);
-  xfree (buf);
-  if (err)
+  if (errlinep)
+    *errlinep = 0;
+  for (line = copy; line < cend; line = next)
     {
-      _gpgrt_nvc_release (*result);
-      *result = NULL;
+      p = memchr (line, '\n', cend - line);
+      next = p? p + 2 : cend;
+
+      if (errlinep)
+	*errlinep += 1;
+
+      err = parse_line (&ps, line,
+                        next >= cend || !continuation_line_p (next));
+      if (err)
+        goto leave;
     }
 
+ leave:
+  err = parse_finish (&ps, err, result);
+  if (!err)
+    (*result)->modified = 0;
   return err;
 }
 
 
-/* Parse STREAM and return a newly allocated name value container
- * structure in RESULT.  If ERRLINEP is given, the line number the
- * parser was last considering is stored there.  For private key
- * containers the GPGRT_NVC_PRIVKEY bit should be set in FLAGS.  */
+/* The state shared by the threads of _gpgrt_nvc_parse_files.  */
+struct parse_files_s
+{
+  gpgrt_lock_t lock;          /* Protects NEXT.  */
+  int next;                   /* Index of the next file to parse.  */
+  int nfiles;
+  const char * const *fnames;
+  gpgrt_nvc_t *results;
+  gpg_err_code_t *errors;
+  unsigned int flags;
+};
+
+
+/* Parse files from the list in ARG until all have been taken.  */
+static void *
+parse_files_worker (void *arg)
+{
+  struct parse_files_s *pf = arg;
+  gpg_err_code_t err;
+  estream_t fp;
+  int idx;
+
+  for (;;)
+    {
+      _gpgrt_lock_lock (&pf->lock);
+      idx = pf->next < pf->nfiles? pf->next++ : -1;
+      _gpgrt_lock_unlock (&pf->lock);
+      if (idx < 0)
+        break;
+
+      pf->results[idx] = NULL;
+      fp = _gpgrt_fopen (pf->fnames[idx], "r");
+      if (!fp)
+        err = _gpg_err_code_from_syserror ();
+      else
+        {
+          err = do_nvc_parse (&pf->results[idx], NULL, fp, pf->flags);
+          _gpgrt_fclose (fp);
+        }
+      pf->errors[idx] = err;
+    }
+
+  return NULL;
+}
+
+
+/* Parse the NFILES files with the names FNAMES and store the
+ * containers at the same index of RESULTS and the error codes at the
+ * same index of ERRORS.  FLAGS are used to allocate the containers.
+ * The files are parsed concurrently by up to NTHREADS threads; a
+ * value of 0 selects a default.  Without thread support the files
+ * are parsed one after the other.  Returns the error code of the
+ * first file which failed or 0 if all files have been parsed.  */
 gpg_err_code_t
-_gpgrt_nvc_parse (gpgrt_nvc_t *result, int *errlinep, estream_t stream,
-                  unsigned int flags)
+_gpgrt_nvc_parse_files (gpgrt_nvc_t *results, gpg_err_code_t *errors,
+                        const char * const *fnames, int nfiles,
+                        unsigned int flags, int nthreads)
 {
-  return do_nvc_parse (result, errlinep, stream, flags);
+  struct parse_files_s pf;
+  int i;
+#ifdef USE_PARSE_THREADS
+  pthread_t threads[PARSE_MAX_THREADS];
+  int nstarted = 0;
+#endif
+
+  if (nfiles < 0 || (nfiles && (!results || !errors || !fnames)))
+    return GPG_ERR_INV_ARG;
+
+  memset (&pf, 0, sizeof pf);
+  _gpgrt_lock_init (&pf.lock);
+  pf.nfiles = nfiles;
+  pf.fnames = fnames;
+  pf.results = results;
+  pf.errors = errors;
+  pf.flags = flags;
+
+  if (nthreads <= 0)
+    nthreads = PARSE_DEFAULT_THREADS;
+  if (nthreads > PARSE_MAX_THREADS)
+    nthreads = PARSE_MAX_THREADS;
+  if (nthreads > nfiles)
+    nthreads = nfiles;
+
+#ifdef USE_PARSE_THREADS
+  /* The calling thread is one of the workers.  If a thread can't be
+   * created we continue with those we have.  */
+  for (; nstarted < nthreads - 1; nstarted++)
+    if (pthread_create (&threads[nstarted], NULL, parse_files_worker, &pf))
+      break;
+  parse_files_worker (&pf);
+  for (i = 0; i < nstarted; i++)
+    pthread_join (threads[i], NULL);
+#else
+  (void)nthreads;
+  parse_files_worker (&pf);
+#endif
+
+  _gpgrt_lock_destroy (&pf.lock);
+
+  for (i = 0; i < nfiles; i++)
+    if (errors[i])
+      return errors[i];
+  return 0;
 }
 
 
-/* Helper for nvc_write.  */
+/* Helper for nvc_write.  SKIP is the number of characters to skip
+ * at the begin of the name.  */
 static gpg_err_code_t
-write_one_entry (gpgrt_nve_t entry, estream_t stream)
+write_one_entry (gpgrt_nve_t entry, size_t skip, estream_t stream)
 {
   gpg_err_code_t err;
   gpgrt_strlist_t sl;
 
   if (entry->name)
-    _gpgrt_fputs (entry->name, stream);
+    _gpgrt_fputs (entry->name + skip, stream);
 
-  err = assert_raw_value (entry);
-  if (err)
-    return err;
+  if (entry->implicit_raw)
+    {
+      _gpgrt_fputc (' ', stream);
+      _gpgrt_fputs (entry->value, stream);
+      _gpgrt_fputc ('\n', stream);
+    }
+  else
+    {
+      err = assert_raw_value (entry);
+      if (err)
+        return err;
 
-  for (sl = entry->raw_value; sl; sl = sl->next)
-    _gpgrt_fputs (sl->d, stream);
+      for (sl = entry->raw_value; sl; sl = sl->next)
+        _gpgrt_fputs (sl->d, stream);
+    }
 
   if (_gpgrt_ferror (stream))
     return _gpg_err_code_from_syserror ();
@@ -909,6 +1595,77 @@ write_one_entry (gpgrt_nve_t entry, estream_t stream)
 }
 
 
+/* Return the length of the section part of the name of ENTRY or 0
+ * if the name has no section.  This is the same rule as used by
+ * valid_name.  */
+static size_t
+section_length (gpgrt_nve_t entry)
+{
+  const char *s;
+
+  if (!entry->name || !(s = strchr (entry->name, ':')) || !s[1] || s[1] == ':')
+    return 0;
+  return s - entry->name;
+}
+
+
+/* Write the container CONT in section mode to STREAM.  The section
+ * headers are not kept by the parser; thus a header is written
+ * whenever the section changes.  Named entries without a section
+ * need to go before the first section header.  */
+static gpg_err_code_t
+write_section_entries (gpgrt_nvc_t cont, estream_t stream)
+{
+  gpg_err_code_t err;
+  gpgrt_nve_t entry, first;
+  const char *section = NULL;
+  size_t seclen = 0;
+  size_t n;
+
+  for (first = cont->first; first; first = first->next)
+    if (section_length (first))
+      break;
+
+  /* All entries before the first section and all named entries
+   * without a section.  */
+  for (entry = cont->first; entry; entry = entry->next)
+    {
+      if (entry == first)
+        break;
+      err = write_one_entry (entry, 0, stream);
+      if (err)
+        return err;
+    }
+  for (; entry; entry = entry->next)
+    if (entry->name && !section_length (entry))
+      {
+        err = write_one_entry (entry, 0, stream);
+        if (err)
+          return err;
+      }
+
+  /* The sections.  */
+  for (entry = first; entry; entry = entry->next)
+    {
+      if (!entry->name)
+        n = 0;
+      else if (!(n = section_length (entry)))
+        continue;  /* Already written.  */
+      else if (!section || n != seclen || memcmp (section, entry->name, n))
+        {
+          section = entry->name;
+          seclen = n;
+          _gpgrt_fprintf (stream, "[%.*s]\n", (int)seclen, section);
+        }
+      err = write_one_entry (entry, n? n + 1 : 0, stream);
+      if (err)
+        return err;
+    }
+
+  return 0;
+}
+
+
 /* Write a representation of CONT to STREAM.  */
 gpg_err_code_t
 _gpgrt_nvc_write (gpgrt_nvc_t cont, estream_t stream)
@@ -917,10 +1674,8 @@ _gpgrt_nvc_write (gpgrt_nvc_t cont, estream_t stream)
   gpgrt_nve_t entry;
   gpgrt_nve_t keyentry = NULL;
 
-  /* We can't yet write out in section mode because we merge entries
-   * from the same section and do not keep a raw representation.  */
   if (cont->section_mode)
-    return GPG_ERR_NOT_IMPLEMENTED;
+    return write_section_entries (cont, stream);
 
   for (entry = cont->first; entry; entry = entry->next)
     {
@@ -932,15 +1687,341 @@ _gpgrt_nvc_write (gpgrt_nvc_t cont, estream_t stream)
           continue;
         }
 
-      err = write_one_entry (entry, stream);
+      err = write_one_entry (entry, 0, stream);
       if (err)
 	return err;
     }
 
   /* In private key mode we write the Key always last.  */
   if (keyentry)
-    err = write_one_entry (keyentry, stream);
+    err = write_one_entry (keyentry, 0, stream);
+
+  return err;
+}
+
+
+/* Create a new temporary file for FNAME in the same directory using
+ * MODE, which must include "x".  The name of the file is stored at
+ * R_TMPNAME.  The name is made unique by the pid and the address of
+ * the name's buffer, which is distinct for concurrent calls, and a
+ * counter to skip stale files left over by a crashed process.  */
+static estream_t
+create_tmpfile (const char *fname, const char *mode, char **r_tmpname)
+{
+  size_t size = strlen (fname) + 50;
+  char *tmpname;
+  estream_t fp;
+  unsigned int i;
+
+  *r_tmpname = NULL;
+  tmpname = xtrymalloc (size);
+  if (!tmpname)
+    return NULL;
+
+  for (i=0; i < 100; i++)
+    {
+      snprintf (tmpname, size, "%s.%lu-%lx-%u.tmp", fname,
+                (unsigned long)getpid (),
+                (unsigned long)(size_t)tmpname, i);
+      fp = _gpgrt_fopen (tmpname, mode);
+      if (fp)
+        {
+          *r_tmpname = tmpname;
+          return fp;
+        }
+      if (errno != EEXIST)
+        break;
+    }
+
+  xfree (tmpname);
+  return NULL;
+}
+
+
+/* Write CONT to the file FNAME if it has been modified since it was
+ * parsed or last written by this function.  The container is written
+ * to a new temporary file in the directory of FNAME which then
+ * replaces FNAME; thus readers see either the old or the new file.
+ * On Windows FNAME is removed before the rename and thus the
+ * replacement is not atomic there.  The permissions of an existing
+ * FNAME are kept.  */
+gpg_err_code_t
+_gpgrt_nvc_update_file (gpgrt_nvc_t cont, const char *fname)
+{
+  gpg_err_code_t err;
+  char *tmpname;
+  estream_t fp;
+#if defined(HAVE_STAT) && !defined(HAVE_W32_SYSTEM)
+  struct stat st;
+  int have_st;
+#endif
+
+  if (!cont || !fname)
+    return GPG_ERR_INV_ARG;
+  if (!cont->modified)
+    return 0;
 
+  /* Containers with secrets get a file only readable by the user.  */
+  fp = create_tmpfile (fname, ((cont->private_key_mode || cont->wipe_on_free)
+                               ? "wx,mode=-rw" : "wx"), &tmpname);
+  if (!fp)
+    return _gpg_err_code_from_syserror ();
+#if defined(HAVE_STAT) && !defined(HAVE_W32_SYSTEM)
+  have_st = !stat (fname, &st);
+#endif
+
+  err = _gpgrt_nvc_write (cont, fp);
+  if (!err && _gpgrt_fflush (fp, 0))
+    err = _gpg_err_code_from_syserror ();
+#if defined(HAVE_STAT) && !defined(HAVE_W32_SYSTEM)
+  if (!err && have_st && fchmod (_gpgrt_fileno (fp), st.st_mode & 07777))
+    err = _gpg_err_code_from_syserror ();
+#endif
+#ifdef HAVE_FSYNC
+  /* Make sure the data is on disk before the rename.  */
+  if (!err && fsync (_gpgrt_fileno (fp)))
+    err = _gpg_err_code_from_syserror ();
+#endif
+  if (_gpgrt_fclose (fp) && !err)
+    err = _gpg_err_code_from_syserror ();
+
+  if (!err)
+    {
+#ifdef HAVE_W32_SYSTEM
+      /* Windows can't rename onto an existing file.  */
+      remove (fname);
+#endif
+      if (rename (tmpname, fname))
+        err = _gpg_err_code_from_syserror ();
+    }
+  if (err)
+    remove (tmpname);
+  else
+    cont->modified = 0;
+
+  xfree (tmpname);
+  return err;
+}
+
+
+/* The binary image of a container starts with this magic which also
+ * encodes the version of the format.  The magic is followed by the
+ * container flags and the number of entries as 32 bit big endian
+ * values.  Each entry is then described by one octet with the
+ * NVBIN_ flags, the name and the value if indicated by the flags,
+ * the number of raw lines, and the raw lines.  All strings are
+ * stored as a 32 bit length followed by the string and a Nul.  */
+#define NVBIN_MAGIC     "\x7fGPGRTNV1"
+#define NVBIN_MAGICLEN  10
+
+/* Container flags in the image.  */
+#define NVBIN_SECTION   1
+#define NVBIN_PRIVKEY   2
+
+/* Entry flags in the image.  */
+#define NVBIN_NAME      1
+#define NVBIN_VALUE     2
+#define NVBIN_IMPLICIT  4
+
+
+static void
+put_u32 (estream_t stream, unsigned int value)
+{
+  unsigned char buf[4];
+
+  buf[0] = value >> 24;
+  buf[1] = value >> 16;
+  buf[2] = value >>  8;
+  buf[3] = value;
+  _gpgrt_fwrite (buf, 4, 1, stream);
+}
+
+
+static void
+put_string (estream_t stream, const char *string)
+{
+  size_t n = strlen (string);
+
+  put_u32 (stream, n);
+  _gpgrt_fwrite (string, n + 1, 1, stream);
+}
+
+
+/* Write a binary image of CONT to STREAM.  The image keeps the
+ * names, the decoded values, the comments and the layout of the raw
+ * lines; it can be loaded with _gpgrt_nvc_load_binary without
+ * parsing the text format.  */
+gpg_err_code_t
+_gpgrt_nvc_save_binary (gpgrt_nvc_t cont, estream_t stream)
+{
+  gpg_err_code_t err;
+  gpgrt_nve_t e;
+  gpgrt_strlist_t sl;
+  unsigned int n;
+
+  for (n=0, e = cont->first; e; e = e->next)
+    {
+      /* Make sure that named entries have a decoded value.  */
+      if (e->name && (err = assert_value (e)))
+        return err;
+      n++;
+    }
+
+  _gpgrt_fwrite (NVBIN_MAGIC, NVBIN_MAGICLEN, 1, stream);
+  put_u32 (stream, ((cont->section_mode? NVBIN_SECTION : 0)
+                    | (cont->private_key_mode? NVBIN_PRIVKEY : 0)));
+  put_u32 (stream, n);
+
+  for (e = cont->first; e; e = e->next)
+    {
+      _gpgrt_fputc (((e->name? NVBIN_NAME : 0)
+                     | (e->value? NVBIN_VALUE : 0)
+                     | (e->implicit_raw? NVBIN_IMPLICIT : 0)), stream);
+      if (e->name)
+        put_string (stream, e->name);
+      if (e->value)
+        put_string (stream, e->value);
+      for (n=0, sl = e->raw_value; sl; sl = sl->next)
+        n++;
+      put_u32 (stream, n);
+      for (sl = e->raw_value; sl; sl = sl->next)
+        put_string (stream, sl->d);
+    }
+
+  if (_gpgrt_ferror (stream))
+    return _gpg_err_code_from_syserror ();
+  return 0;
+}
+
+
+/* Read a 32 bit value from the image at *R_P with the end END.
+ * Returns false if the image is too short.  */
+static int
+get_u32 (const unsigned char **r_p, const unsigned char *end,
+         unsigned int *r_value)
+{
+  const unsigned char *p = *r_p;
+
+  if (end - p < 4)
+    return 0;
+  *r_value = ((unsigned int)p[0] << 24 | (unsigned int)p[1] << 16
+              | (unsigned int)p[2] << 8 | p[3]);
+  *r_p = p + 4;
+  return 1;
+}
+
+
+/* Return a pointer to the string stored at *R_P in the image with the
+ * end END or NULL if the image is corrupt.  */
+static char *
+get_string (const unsigned char **r_p, const unsigned char *end)
+{
+  const unsigned char *p;
+  unsigned int n;
+
+  if (!get_u32 (r_p, end, &n))
+    return NULL;
+  p = *r_p;
+  if (n >= (size_t)(end - p) || p[n] || memchr (p, 0, n))
+    return NULL;
+  *r_p = p + n + 1;
+  return (char *)p;
+}
+
+
+/* Create a new container at RESULT from the binary image of LENGTH
+ * bytes at BUFFER as written by _gpgrt_nvc_save_binary.  The section
+ * and the private key mode are taken from the image; other FLAGS are
+ * used to allocate the container which is always done in arena
+ * mode.  The image is copied once into the arena and the names and
+ * values are used directly from that copy.  */
+gpg_err_code_t
+_gpgrt_nvc_load_binary (gpgrt_nvc_t *result,
+                        const void *buffer, size_t length, unsigned int flags)
+{
+  gpg_err_code_t err = 0;
+  gpgrt_nvc_t cont;
+  const unsigned char *p, *end;
+  unsigned char *copy;
+  unsigned int cflags, nentries, nraw, eflags;
+  char *name, *value, *line;
+  gpgrt_strlist_t raw_value = NULL;
+  gpgrt_strlist_t tail = NULL;
+
+  *result = NULL;
+  if (length < NVBIN_MAGICLEN || memcmp (buffer, NVBIN_MAGIC, NVBIN_MAGICLEN))
+    return GPG_ERR_INV_OBJ;
+  p = (const unsigned char *)buffer + NVBIN_MAGICLEN;
+  end = (const unsigned char *)buffer + length;
+  if (!get_u32 (&p, end, &cflags) || !get_u32 (&p, end, &nentries))
+    return GPG_ERR_BAD_DATA;
+
+  flags &= ~(GPGRT_NVC_SECTION | GPGRT_NVC_PRIVKEY);
+  if ((cflags & NVBIN_SECTION))
+    flags |= GPGRT_NVC_SECTION;
+  if ((cflags & NVBIN_PRIVKEY))
+    flags |= GPGRT_NVC_PRIVKEY;
+  cont = _gpgrt_nvc_new (flags | GPGRT_NVC_ARENA);
+  if (!cont)
+    return _gpg_err_code_from_syserror ();
+
+  /* Work on a copy of the entries.  */
+  copy = arena_alloc (cont->arena, end - p);
+  if (!copy)
+    {
+      err = _gpg_err_code_from_syserror ();
+      goto leave;
+    }
+  memcpy (copy, p, end - p);
+  end = copy + (end - p);
+  p = copy;
+
+  for (; nentries; nentries--)
+    {
+      name = value = NULL;
+      if (p == end)
+        goto bad_data;
+      eflags = *p++;
+      if ((eflags & NVBIN_NAME) && !(name = get_string (&p, end)))
+        goto bad_data;
+      if ((eflags & NVBIN_VALUE) && !(value = get_string (&p, end)))
+        goto bad_data;
+      if (!get_u32 (&p, end, &nraw))
+        goto bad_data;
+      for (; nraw; nraw--)
+        {
+          if (!(line = get_string (&p, end)))
+            goto bad_data;
+          if (!raw_append (cont->arena, &raw_value, &tail, line,
+                           cont->wipe_on_free))
+            {
+              err = _gpg_err_code_from_syserror ();
+              goto leave;
+            }
+        }
+      if (!value && !raw_value)
+        goto bad_data;
+      if ((eflags & NVBIN_IMPLICIT) && (!name || !value || raw_value))
+        goto bad_data;
+
+      err = do_nvc_add (cont, name, value, raw_value, 1);
+      raw_value = tail = NULL;
+      if (err)
+        goto leave;
+      cont->last->implicit_raw = !!(eflags & NVBIN_IMPLICIT);
+    }
+  if (p != end)
+    goto bad_data;
+
+  cont->modified = 0;
+  *result = cont;
+  return 0;
+
+ bad_data:
+  err = GPG_ERR_BAD_DATA;
+ leave:
+  raw_release (cont->arena, raw_value, cont->wipe_on_free);
+  _gpgrt_nvc_release (cont);
   return err;
 }
 
@@ -30,10 +30,56 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <ctype.h>
 
 #include "gpgrt-int.h"
 
 #define SL_PRIV_FLAG_WIPE   0x01
+#define SL_PRIV_FLAG_SLAB   0x02  /* Item is part of a slab.  */
+
+
+/* With GPGRT_STRLIST_SLAB the tokenizer allocates all items in one
+ * block of memory.  The block starts with this header and each item
+ * in the block is preceded by a pointer to the header.  The block is
+ * released when its last item has been freed; thus the items may
+ * still be freed, popped, or reordered one by one.  */
+struct strlist_slab_s
+{
+  size_t refcount;  /* Number of items not yet freed.  */
+};
+
+/* Round N up to the alignment used for the items of a slab.  */
+#define SLAB_ROUND(n) (((n) + sizeof (void*) - 1) & ~(sizeof (void*) - 1))
+
+/* The space needed in a slab for an item with a string of length N
+ * and the offset of the first item.  */
+#define SLAB_ITEMSIZE(n) SLAB_ROUND (sizeof (struct strlist_slab_s *)   \
+                                     + sizeof (struct _gpgrt_strlist_s) \
+                                     + (n))
+#define SLAB_HEADSIZE    SLAB_ROUND (sizeof (struct strlist_slab_s))
+
+
+/* Release the single item SL.  */
+static void
+free_item (gpgrt_strlist_t sl)
+{
+  unsigned char privflags = sl->_private_flags;
+  struct strlist_slab_s *slab;
+
+  if ((privflags & ~(SL_PRIV_FLAG_WIPE|SL_PRIV_FLAG_SLAB)))
+    _gpgrt_log_fatal ("gpgrt_strlist_free: corrupted object %p\n", sl);
+
+  if ((privflags & SL_PRIV_FLAG_WIPE))
+    _gpgrt_wipememory (sl, sizeof *sl + strlen (sl->d));
+  if ((privflags & SL_PRIV_FLAG_SLAB))
+    {
+      slab = ((struct strlist_slab_s **)sl)[-1];
+      if (!--slab->refcount)
+        xfree (slab);
+    }
+  else
+    xfree (sl);
+}
 
 
 void
@@ -44,22 +90,19 @@ _gpgrt_strlist_free (gpgrt_strlist_t sl)
   for (; sl; sl = sl2)
     {
       sl2 = sl->next;
-      if ((sl->_private_flags & ~SL_PRIV_FLAG_WIPE))
-        _gpgrt_log_fatal ("gpgrt_strlist_free: corrupted object %p\n", sl);
-
-      if ((sl->_private_flags & SL_PRIV_FLAG_WIPE))
-        _gpgrt_wipememory (sl, sizeof *sl + strlen (sl->d));
-      xfree(sl);
+      free_item (sl);
     }
 }
 
 
 /* Core of gpgrt_strlist_append which take the length of the string.
+ * If TAILP is not NULL and points to an item of LIST, the search for
+ * the end of the list starts there; it is updated to the new item.
  * Return the item added to the end of the list.  Or NULL in case of
  * an error.  */
 static gpgrt_strlist_t
-do_strlist_append (gpgrt_strlist_t *list, const char *string, size_t stringlen,
-                   unsigned int flags)
+do_strlist_append (gpgrt_strlist_t *list, gpgrt_strlist_t *tailp,
+                   const char *string, size_t stringlen, unsigned int flags)
 {
   gpgrt_strlist_t r, sl;
 
@@ -76,10 +119,13 @@ do_strlist_append (gpgrt_strlist_t *list, const char *string, size_t stringlen,
     *list = sl;
   else
     {
-      for (r = *list; r->next; r = r->next)
+      r = (tailp && *tailp)? *tailp : *list;
+      for (; r->next; r = r->next)
         ;
       r->next = sl;
     }
+  if (tailp)
+    *tailp = sl;
   return sl;
 }
 
@@ -100,7 +146,7 @@ _gpgrt_strlist_add (gpgrt_strlist_t *list, const char *string,
     string = "";
 
   if ((flags & GPGRT_STRLIST_APPEND))
-    return do_strlist_append (list, string, strlen (string), flags);
+    return do_strlist_append (list, NULL, string, strlen (string), flags);
 
   /* Default is to prepend.  */
   sl = xtrymalloc (sizeof *sl + strlen (string));
@@ -115,11 +161,113 @@ _gpgrt_strlist_add (gpgrt_strlist_t *list, const char *string,
   return sl;
 }
 
+
+/* Append STRING to the LIST.  TAILP points to a variable with the
+ * last item of LIST or NULL; it is updated to the new item so that
+ * building a list by repeated calls does not need to walk the list.
+ * This function returns NULL and sets ERRNO on memory shortage.  If
+ * STRING is NULL an empty string is stored instead.  Only
+ * GPGRT_STRLIST_WIPE has an effect in FLAGS.  */
+gpgrt_strlist_t
+_gpgrt_strlist_append (gpgrt_strlist_t *list, gpgrt_strlist_t *tailp,
+                       const char *string, unsigned int flags)
+{
+  if (!string)
+    string = "";
+
+  return do_strlist_append (list, tailp, string, strlen (string), flags);
+}
+
+
+/* Helper for _gpgrt_strlist_tokenize to create the list of tokens in
+ * a single slab.  A bitmap of the delimiters is used so that each
+ * character needs to be looked at only once per pass.  The first pass
+ * computes the size of the slab and the second pass fills it.
+ * Returns NULL and sets ERRNO on error.  */
+static gpgrt_strlist_t
+tokenize_slab (const char *string, const char *delim, unsigned int flags)
+{
+  unsigned char dmap[32];
+  const unsigned char *s, *se, *b, *e;
+  struct strlist_slab_s *slab = NULL;
+  char *p = NULL;
+  gpgrt_strlist_t newlist = NULL;
+  gpgrt_strlist_t sl, tail = NULL;
+  size_t ntokens = 0;
+  size_t nbytes = SLAB_HEADSIZE;
+  int pass;
+
+  memset (dmap, 0, sizeof dmap);
+  for (s = (const unsigned char *)delim; *s; s++)
+    dmap[*s >> 3] |= 1 << (*s & 7);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      s = (const unsigned char *)string;
+      for (;;)
+        {
+          for (se = s; *se && !(dmap[*se >> 3] & (1 << (*se & 7))); se++)
+            ;
+          /* Trim the spaces like _gpgrt_trim_spaces.  */
+          for (b = s; b < se && isspace (*b); b++)
+            ;
+          for (e = se; e > b && isspace (e[-1]); e--)
+            ;
+          if (e > b && !pass)
+            {
+              ntokens++;
+              nbytes += SLAB_ITEMSIZE (e - b);
+            }
+          else if (e > b)
+            {
+              *(struct strlist_slab_s **)p = slab;
+              sl = (gpgrt_strlist_t)(p + sizeof (struct strlist_slab_s *));
+              sl->next = NULL;
+              sl->flags = 0;
+              sl->_private_flags = SL_PRIV_FLAG_SLAB;
+              if ((flags & GPGRT_STRLIST_WIPE))
+                sl->_private_flags |= SL_PRIV_FLAG_WIPE;
+              memcpy (sl->d, b, e - b);
+              sl->d[e - b] = 0;
+              if (tail)
+                tail->next = sl;
+              else
+                newlist = sl;
+              tail = sl;
+              p += SLAB_ITEMSIZE (e - b);
+            }
+          if (!*se)
+            break;
+          s = se + 1;
+        }
+
+      if (!pass)
+        {
+          if (!ntokens)
+            {
+              _gpg_err_set_errno (ENOENT);
+              return NULL;
+            }
+          slab = xtrymalloc (nbytes);
+          if (!slab)
+            return NULL;
+          slab->refcount = ntokens;
+          p = (char *)slab + SLAB_HEADSIZE;
+        }
+    }
+
+  return newlist;
+}
+
+
 /* Tokenize STRING using the delimiters from DELIM and append each
  * token to the string list LIST.  On success a pointer into LIST with
  * the first new token is returned.  Returns NULL on error and sets
  * ERRNO.  Take care, an error with ENOENT set mean that no tokens
- * were found in STRING.  Only GPGRT_STRLIST_WIPE has an effect here.  */
+ * were found in STRING.  Only GPGRT_STRLIST_WIPE and
+ * GPGRT_STRLIST_SLAB have an effect here.  With the latter all new
+ * items are allocated in one block which is released with the last
+ * of these items.  */
 gpgrt_strlist_t
 _gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
                          const char *delim, unsigned int flags)
@@ -127,11 +275,20 @@ _gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
   const char *s, *se;
   size_t n;
   gpgrt_strlist_t newlist = NULL;
-  gpgrt_strlist_t tail;
+  gpgrt_strlist_t tail = NULL;
+  gpgrt_strlist_t prevtail;
 
   if (!string)
     string = "";
 
+  if ((flags & GPGRT_STRLIST_SLAB))
+    {
+      newlist = tokenize_slab (string, delim, flags);
+      if (!newlist)
+        return NULL;
+      goto append;
+    }
+
   s = string;
   do
     {
@@ -142,8 +299,8 @@ _gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
         n = strlen (s);
       if (!n)
         continue;  /* Skip empty string.  */
-      tail = do_strlist_append (&newlist, s, n, flags);
-      if (!tail)
+      prevtail = tail;
+      if (!do_strlist_append (&newlist, &tail, s, n, flags))
         {
           _gpgrt_strlist_free (newlist);
           return NULL;
@@ -151,7 +308,7 @@ _gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
       _gpgrt_trim_spaces (tail->d);
       if (!*tail->d)  /* Remove new but empty item from the list.  */
         {
-          tail = _gpgrt_strlist_prev (newlist, tail);
+          tail = prevtail;
           if (tail)
             {
               _gpgrt_strlist_free (tail->next);
@@ -175,6 +332,7 @@ _gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
       return NULL;
     }
 
+ append:
   /* Append NEWLIST to LIST.  */
   if (!*list)
     *list = newlist;
@@ -205,11 +363,11 @@ _gpgrt_strlist_copy (gpgrt_strlist_t list)
           return NULL;
         }
       sl->flags = list->flags;
-      sl->_private_flags = list->_private_flags;
+      sl->_private_flags = (list->_private_flags & SL_PRIV_FLAG_WIPE);
       strcpy (sl->d, list->d);
       sl->next = NULL;
       *last = sl;
-      last = &sl;
+      last = &sl->next;
     }
   return newlist;
 }
@@ -272,7 +430,7 @@ _gpgrt_strlist_pop (gpgrt_strlist_t *list)
 
       *list = sl->next;
       sl->next = NULL;
-      xfree (sl);
+      free_item (sl);
     }
 
   return str;
@@ -289,3 +447,269 @@ _gpgrt_strlist_find (gpgrt_strlist_t haystack, const char *needle)
       return haystack;
   return NULL;
 }
+
+
+
+/*
+ * Hashed string sets
+ */
+
+/* The initial number of slots of a string set.  This must be a power
+ * of 2.  The table is grown when it is half full.  */
+#define STRSET_INITIAL_SLOTS 16
+
+/* A string of the set and its hash value.  */
+struct strset_item_s
+{
+  unsigned int hash;
+  char *string;
+};
+
+/* A set of strings using open addressing with linear probing.  The
+ * slots hold the index plus one into ITEMS so that the strings are
+ * kept in insertion order.  */
+struct _gpgrt_strset_s
+{
+  unsigned int flags;       /* GPGRT_STRSET_ flags.  */
+  unsigned int count;       /* Number of strings in the set.  */
+  unsigned int nslots;      /* Number of slots.  */
+  unsigned int *slots;      /* The hash table or NULL.  */
+  unsigned int nitems;      /* Allocated number of ITEMS.  */
+  struct strset_item_s *items;
+};
+
+
+static GPG_ERR_INLINE int
+strset_toupper (int c)
+{
+  return (c >= 'a' && c <= 'z')? c - 'a' + 'A' : c;
+}
+
+
+static unsigned int
+strset_hash (gpgrt_strset_t set, const char *string)
+{
+  unsigned int h = 2166136261u;  /* FNV-1a */
+
+  if ((set->flags & GPGRT_STRSET_ICASE))
+    for (; *string; string++)
+      {
+        h ^= (unsigned char)strset_toupper (*string);
+        h *= 16777619u;
+      }
+  else
+    for (; *string; string++)
+      {
+        h ^= (unsigned char)*string;
+        h *= 16777619u;
+      }
+  return h;
+}
+
+
+static int
+strset_equal (gpgrt_strset_t set, const char *a, const char *b)
+{
+  if (!(set->flags & GPGRT_STRSET_ICASE))
+    return !strcmp (a, b);
+
+  for (; *a && *b; a++, b++)
+    if (*a != *b && strset_toupper (*a) != strset_toupper (*b))
+      return 0;
+  return *a == *b;
+}
+
+
+/* Return the slot of STRING with HASH in SET or the free slot where
+ * it would be stored.  SET must have a table.  */
+static unsigned int
+strset_find_slot (gpgrt_strset_t set, const char *string, unsigned int hash)
+{
+  unsigned int mask = set->nslots - 1;
+  unsigned int i, idx;
+
+  for (i = hash & mask; (idx = set->slots[i]); i = (i + 1) & mask)
+    if (set->items[idx-1].hash == hash
+        && strset_equal (set, set->items[idx-1].string, string))
+      break;
+  return i;
+}
+
+
+/* Double the size of the table and the items of SET.  Returns 0 on
+ * success or an error code.  */
+static gpg_err_code_t
+strset_grow (gpgrt_strset_t set)
+{
+  unsigned int nslots = set->nslots? 2 * set->nslots : STRSET_INITIAL_SLOTS;
+  unsigned int *slots;
+  struct strset_item_s *items;
+  unsigned int i, j;
+
+  slots = xtrycalloc (nslots, sizeof *slots);
+  if (!slots)
+    return _gpg_err_code_from_syserror ();
+  items = xtryrealloc (set->items, nslots / 2 * sizeof *items);
+  if (!items)
+    {
+      xfree (slots);
+      return _gpg_err_code_from_syserror ();
+    }
+
+  for (i = 0; i < set->count; i++)
+    {
+      for (j = items[i].hash & (nslots - 1); slots[j]; j = (j + 1) & (nslots-1))
+        ;
+      slots[j] = i + 1;
+    }
+
+  xfree (set->slots);
+  set->slots = slots;
+  set->nslots = nslots;
+  set->items = items;
+  set->nitems = nslots / 2;
+  return 0;
+}
+
+
+/* Create a new and empty string set.  FLAGS are these bits:
+ *  GPGRT_STRSET_ICASE - Compare the strings case-insensitive (ASCII).
+ *  GPGRT_STRSET_WIPE  - Wipe the strings on release.
+ * Returns NULL and sets ERRNO on error.  */
+gpgrt_strset_t
+_gpgrt_strset_new (unsigned int flags)
+{
+  gpgrt_strset_t set;
+
+  set = xtrycalloc (1, sizeof *set);
+  if (set)
+    set->flags = flags;
+  return set;
+}
+
+
+/* Release the string SET.  */
+void
+_gpgrt_strset_release (gpgrt_strset_t set)
+{
+  unsigned int i;
+
+  if (!set)
+    return;
+
+  for (i = 0; i < set->count; i++)
+    {
+      if ((set->flags & GPGRT_STRSET_WIPE))
+        _gpgrt_wipememory (set->items[i].string,
+                           strlen (set->items[i].string));
+      xfree (set->items[i].string);
+    }
+  xfree (set->items);
+  xfree (set->slots);
+  xfree (set);
+}
+
+
+/* Add STRING to SET.  Adding a string which is already in the set
+ * does nothing.  Returns 0 on success or an error code.  */
+gpg_err_code_t
+_gpgrt_strset_add (gpgrt_strset_t set, const char *string)
+{
+  gpg_err_code_t err;
+  unsigned int hash, slot;
+  char *copy;
+
+  if (!set || !string)
+    return GPG_ERR_INV_ARG;
+
+  hash = strset_hash (set, string);
+  if (set->slots)
+    {
+      slot = strset_find_slot (set, string, hash);
+      if (set->slots[slot])
+        return 0;  /* Already in the set.  */
+    }
+  if (set->count == set->nitems)
+    {
+      err = strset_grow (set);
+      if (err)
+        return err;
+    }
+
+  copy = xtrystrdup (string);
+  if (!copy)
+    return _gpg_err_code_from_syserror ();
+  slot = strset_find_slot (set, string, hash);
+  set->items[set->count].hash = hash;
+  set->items[set->count].string = copy;
+  set->slots[slot] = ++set->count;
+  return 0;
+}
+
+
+/* Return true if STRING is in SET.  */
+int
+_gpgrt_strset_contains (gpgrt_strset_t set, const char *string)
+{
+  if (!set || !string || !set->count)
+    return 0;
+  return !!set->slots[strset_find_slot (set, string,
+                                        strset_hash (set, string))];
+}
+
+
+/* Return the number of strings in SET.  */
+unsigned int
+_gpgrt_strset_count (gpgrt_strset_t set)
+{
+  return set? set->count : 0;
+}
+
+
+/* Add all strings of LIST to SET.  Returns 0 on success or an error
+ * code.  */
+gpg_err_code_t
+_gpgrt_strset_add_strlist (gpgrt_strset_t set, gpgrt_strlist_t list)
+{
+  gpg_err_code_t err;
+
+  for (; list; list = list->next)
+    if ((err = _gpgrt_strset_add (set, list->d)))
+      return err;
+  return 0;
+}
+
+
+/* Append all strings of SET in the order they were added to the
+ * string list at R_LIST.  The items are marked for wiping if SET has
+ * the GPGRT_STRSET_WIPE flag.  Returns 0 on success or an error
+ * code; on error R_LIST is not changed.  */
+gpg_err_code_t
+_gpgrt_strset_to_strlist (gpgrt_strset_t set, gpgrt_strlist_t *r_list)
+{
+  gpgrt_strlist_t newlist = NULL;
+  gpgrt_strlist_t tail = NULL;
+  unsigned int i;
+
+  if (!set || !r_list)
+    return GPG_ERR_INV_ARG;
+
+  for (i = 0; i < set->count; i++)
+    if (!_gpgrt_strlist_append (&newlist, &tail, set->items[i].string,
+                                ((set->flags & GPGRT_STRSET_WIPE)
+                                 ? GPGRT_STRLIST_WIPE : 0)))
+      {
+        gpg_err_code_t err = _gpg_err_code_from_syserror ();
+        _gpgrt_strlist_free (newlist);
+        return err;
+      }
+
+  if (newlist)
+    {
+      if (!*r_list)
+        *r_list = newlist;
+      else
+        _gpgrt_strlist_last (*r_list)->next = newlist;
+    }
+  return 0;
+}
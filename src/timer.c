@@ -0,0 +1,486 @@
+/* timer.c - Lightweight timing of code spans
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of Libgpg-error.
+ *
+ * Libgpg-error is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgpg-error is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* The timers are meant to profile hot code paths of long running
+ * processes.  Instead of logging each event, the durations are
+ * aggregated per name and only a summary is written to the log on
+ * request or at process termination.  Each thread records into its
+ * own table so that threads do not contend for a lock; the tables
+ * are merged only for the summary.
+ *
+ * The owning thread updates the figures of its table without taking
+ * the lock of the table; the lock only guards the list of timers
+ * against a concurrent dump.  A dump thus may see the figures of a
+ * span only partly accounted.  A reset does not touch the figures of
+ * other threads but bumps a counter in their table, so that the
+ * owner clears its figures on its next use of a timer.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#ifdef HAVE_W32_SYSTEM
+# ifdef HAVE_WINSOCK2_H
+#  include <winsock2.h>
+# endif
+# include <windows.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+# include <sys/time.h>
+#endif
+#if USE_POSIX_THREADS && !USE_POSIX_THREADS_WEAK
+# include <pthread.h>
+# define USE_THREAD_TABLES 1
+#endif
+
+#include "gpgrt-int.h"
+
+
+/* Number of histogram buckets.  Bucket 0 counts durations below one
+ * microsecond, bucket N those from 2^(N-1) to 2^N - 1 microseconds,
+ * and the last bucket all longer durations.  */
+#define TIMER_BUCKETS 32
+
+/* The statistics for one timer.  */
+struct timer_stat_s
+{
+  struct timer_stat_s *next;
+  unsigned long long start;  /* Start time in ns or 0 if not running.  */
+  unsigned long count;       /* Number of completed spans.  */
+  unsigned long long total;  /* Sum of the durations in ns.  */
+  unsigned long long max;    /* Longest duration in ns.  */
+  unsigned long hist[TIMER_BUCKETS];
+  const char *key;           /* The NAME argument of the last call.  */
+  char name[1];
+};
+
+/* The timers of one thread.  */
+struct timer_table_s
+{
+  struct timer_table_s *next;
+  gpgrt_lock_t lock;  /* Protects the list STATS against a dump.  */
+  struct timer_stat_s *stats;
+  struct timer_stat_s *last;  /* The last used timer.  */
+  volatile unsigned int reset_seq;    /* Bumped by a dump with reset.  */
+  volatile unsigned int cleared_seq;  /* RESET_SEQ at the last clear.  */
+};
+
+#ifdef USE_THREAD_TABLES
+/* Only the owning thread uses its table; the lock is required only
+ * to change the list of timers.  */
+# define lock_owner(tbl)   do { } while (0)
+# define unlock_owner(tbl) do { } while (0)
+# define lock_list(tbl)    _gpgrt_lock_lock (&(tbl)->lock)
+# define unlock_list(tbl)  _gpgrt_lock_unlock (&(tbl)->lock)
+#else
+/* All threads share one table and need to take its lock.  */
+# define lock_owner(tbl)   _gpgrt_lock_lock (&(tbl)->lock)
+# define unlock_owner(tbl) _gpgrt_lock_unlock (&(tbl)->lock)
+# define lock_list(tbl)    do { } while (0)
+# define unlock_list(tbl)  do { } while (0)
+#endif
+
+
+/* Lock to protect TIMER_TABLES and RETIRED_STATS.  */
+GPGRT_LOCK_DEFINE (timer_lock);
+
+/* The list of all tables in use.  */
+static struct timer_table_s *timer_tables;
+
+/* The statistics of terminated threads.  */
+static struct timer_stat_s *retired_stats;
+
+#ifdef USE_THREAD_TABLES
+static pthread_once_t timer_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t timer_key;
+static int timer_key_okay;
+#endif
+
+
+
+/* Return a monotonic time in nanoseconds.  */
+static unsigned long long
+now_ns (void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (!clock_gettime (CLOCK_MONOTONIC, &ts))
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  return 0;
+#elif defined(HAVE_W32_SYSTEM)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER cnt;
+
+  if (!freq.QuadPart && !QueryPerformanceFrequency (&freq))
+    return 0;
+  QueryPerformanceCounter (&cnt);
+  return ((unsigned long long)(cnt.QuadPart / freq.QuadPart) * 1000000000ull
+          + ((unsigned long long)(cnt.QuadPart % freq.QuadPart) * 1000000000ull
+             / freq.QuadPart));
+#elif defined(HAVE_GETTIMEOFDAY)
+  struct timeval tv;
+
+  if (!gettimeofday (&tv, NULL))
+    return tv.tv_sec * 1000000000ull + tv.tv_usec * 1000ull;
+  return 0;
+#else
+  return time (NULL) * 1000000000ull;
+#endif
+}
+
+
+/* Find the timer NAME in the list at R_LIST.  If CREATE is set a new
+ * item is added if it does not yet exist.  Returns NULL if not found
+ * or on malloc failure.  */
+static struct timer_stat_s *
+find_stat (struct timer_stat_s **r_list, const char *name, int create)
+{
+  struct timer_stat_s *st;
+
+  for (st = *r_list; st; st = st->next)
+    if (!strcmp (st->name, name))
+      return st;
+  if (!create)
+    return NULL;
+
+  st = _gpgrt_calloc (1, sizeof *st + strlen (name));
+  if (!st)
+    return NULL;
+  strcpy (st->name, name);
+  st->next = *r_list;
+  *r_list = st;
+  return st;
+}
+
+
+/* Add the figures of SRC to the timer of the same name in the list at
+ * R_LIST.  */
+static void
+merge_stat (struct timer_stat_s **r_list, const struct timer_stat_s *src)
+{
+  struct timer_stat_s *st;
+  int i;
+
+  st = find_stat (r_list, src->name, 1);
+  if (!st)
+    return;
+  st->count += src->count;
+  st->total += src->total;
+  if (src->max > st->max)
+    st->max = src->max;
+  for (i=0; i < TIMER_BUCKETS; i++)
+    st->hist[i] += src->hist[i];
+}
+
+
+/* Clear the figures of all timers in TBL but keep running timers
+ * running.  */
+static void
+clear_stats (struct timer_table_s *tbl)
+{
+  struct timer_stat_s *st;
+
+  for (st = tbl->stats; st; st = st->next)
+    {
+      st->count = 0;
+      st->total = 0;
+      st->max = 0;
+      memset (st->hist, 0, sizeof st->hist);
+    }
+}
+
+
+/* Return the timer NAME from the table TBL of the current thread.  If
+ * CREATE is set a new timer is added if it does not yet exist.  The
+ * last used timer is cached and compared by the address of NAME
+ * first, so that the usual string literals do not need a string
+ * comparison.  A reset requested by a dump is applied here.  */
+static struct timer_stat_s *
+lookup_stat (struct timer_table_s *tbl, const char *name, int create)
+{
+  struct timer_stat_s *st;
+  unsigned int seq;
+
+  seq = tbl->reset_seq;
+  if (seq != tbl->cleared_seq)
+    {
+      clear_stats (tbl);
+      tbl->cleared_seq = seq;
+    }
+
+  st = tbl->last;
+  if (!st || (st->key != name && strcmp (st->name, name)))
+    {
+      st = find_stat (&tbl->stats, name, 0);
+      if (!st && create)
+        {
+          lock_list (tbl);
+          st = find_stat (&tbl->stats, name, 1);
+          unlock_list (tbl);
+        }
+      if (!st)
+        return NULL;
+      tbl->last = st;
+    }
+  st->key = name;
+  return st;
+}
+
+
+static void
+release_stats (struct timer_stat_s *list)
+{
+  struct timer_stat_s *st;
+
+  while (list)
+    {
+      st = list->next;
+      _gpgrt_free (list);
+      list = st;
+    }
+}
+
+
+/* Write the summary at process termination.  */
+static void
+timer_atexit (void)
+{
+  _gpgrt_timer_dump (0);
+}
+
+
+/* Create a new timer table and put it into the global list.  The
+ * caller must hold TIMER_LOCK.  */
+static struct timer_table_s *
+new_table (void)
+{
+  static int atexit_registered;
+  struct timer_table_s *tbl;
+
+  tbl = _gpgrt_calloc (1, sizeof *tbl);
+  if (!tbl)
+    return NULL;
+  _gpgrt_lock_init (&tbl->lock);
+
+  tbl->next = timer_tables;
+  timer_tables = tbl;
+  if (!atexit_registered)
+    {
+      atexit_registered = 1;
+      atexit (timer_atexit);
+    }
+  return tbl;
+}
+
+
+#ifdef USE_THREAD_TABLES
+/* Destructor for the table of a terminating thread.  Its figures are
+ * kept for the summary.  */
+static void
+thread_table_release (void *arg)
+{
+  struct timer_table_s *tbl = arg;
+  struct timer_table_s **tp;
+  struct timer_stat_s *st;
+
+  _gpgrt_lock_lock (&timer_lock);
+  for (tp = &timer_tables; *tp; tp = &(*tp)->next)
+    if (*tp == tbl)
+      {
+        *tp = tbl->next;
+        break;
+      }
+  /* Figures not yet cleared after a reset are not to be reported.  */
+  if (tbl->reset_seq == tbl->cleared_seq)
+    for (st = tbl->stats; st; st = st->next)
+      merge_stat (&retired_stats, st);
+  _gpgrt_lock_unlock (&timer_lock);
+
+  release_stats (tbl->stats);
+  _gpgrt_lock_destroy (&tbl->lock);
+  _gpgrt_free (tbl);
+}
+
+
+static void
+create_timer_key (void)
+{
+  if (!pthread_key_create (&timer_key, thread_table_release))
+    timer_key_okay = 1;
+}
+#endif /*USE_THREAD_TABLES*/
+
+
+/* Return the timer table of the current thread or NULL.  */
+static struct timer_table_s *
+get_table (void)
+{
+#ifdef USE_THREAD_TABLES
+  struct timer_table_s *tbl;
+
+  pthread_once (&timer_key_once, create_timer_key);
+  if (!timer_key_okay)
+    return NULL;
+  tbl = pthread_getspecific (timer_key);
+  if (!tbl)
+    {
+      _gpgrt_lock_lock (&timer_lock);
+      tbl = new_table ();
+      _gpgrt_lock_unlock (&timer_lock);
+      if (tbl && pthread_setspecific (timer_key, tbl))
+        {
+          thread_table_release (tbl);
+          tbl = NULL;
+        }
+    }
+  return tbl;
+#else /*!USE_THREAD_TABLES*/
+  /* Without thread specific data all threads share one table.  */
+  static struct timer_table_s *the_table;
+  struct timer_table_s *tbl;
+
+  _gpgrt_lock_lock (&timer_lock);
+  if (!the_table)
+    the_table = new_table ();
+  tbl = the_table;
+  _gpgrt_lock_unlock (&timer_lock);
+  return tbl;
+#endif /*!USE_THREAD_TABLES*/
+}
+
+
+/* Start the timer NAME for the current thread.  A running timer of
+ * that name is restarted.  */
+void
+_gpgrt_timer_start (const char *name)
+{
+  struct timer_table_s *tbl;
+  struct timer_stat_s *st;
+
+  if (!name || !(tbl = get_table ()))
+    return;
+
+  lock_owner (tbl);
+  st = lookup_stat (tbl, name, 1);
+  if (st)
+    {
+      st->start = now_ns ();
+      if (!st->start)
+        st->start = 1;
+    }
+  unlock_owner (tbl);
+}
+
+
+/* Stop the timer NAME of the current thread and account the elapsed
+ * time.  Stopping a timer which is not running does nothing.  */
+void
+_gpgrt_timer_stop (const char *name)
+{
+  unsigned long long now = now_ns ();
+  unsigned long long d, usec;
+  struct timer_table_s *tbl;
+  struct timer_stat_s *st;
+  int idx;
+
+  if (!name || !(tbl = get_table ()))
+    return;
+
+  lock_owner (tbl);
+  st = lookup_stat (tbl, name, 0);
+  if (st && st->start)
+    {
+      d = now > st->start? now - st->start : 0;
+      st->start = 0;
+      st->count++;
+      st->total += d;
+      if (d > st->max)
+        st->max = d;
+      for (idx = 0, usec = d / 1000; usec && idx < TIMER_BUCKETS - 1; idx++)
+        usec >>= 1;
+      st->hist[idx]++;
+    }
+  unlock_owner (tbl);
+}
+
+
+/* Log a summary of all timers of all threads at the debug level.  If
+ * RESET is set the figures are cleared afterwards.  */
+void
+_gpgrt_timer_dump (int reset)
+{
+  struct timer_table_s *tbl;
+  struct timer_stat_s *merged = NULL;
+  struct timer_stat_s *st;
+  char line[TIMER_BUCKETS * 24];
+  size_t n;
+  int i;
+
+  _gpgrt_lock_lock (&timer_lock);
+  for (st = retired_stats; st; st = st->next)
+    merge_stat (&merged, st);
+  if (reset)
+    {
+      release_stats (retired_stats);
+      retired_stats = NULL;
+    }
+  for (tbl = timer_tables; tbl; tbl = tbl->next)
+    {
+      _gpgrt_lock_lock (&tbl->lock);
+      /* Skip figures which the owner did not yet clear after an
+       * earlier reset.  */
+      if (tbl->reset_seq == tbl->cleared_seq)
+        {
+          for (st = tbl->stats; st; st = st->next)
+            if (st->count)
+              merge_stat (&merged, st);
+          if (reset)
+            tbl->reset_seq++;
+        }
+      _gpgrt_lock_unlock (&tbl->lock);
+    }
+  _gpgrt_lock_unlock (&timer_lock);
+
+  for (st = merged; st; st = st->next)
+    {
+      if (!st->count)
+        continue;
+      _gpgrt_log_debug_nolimit ("timer %s: %lu calls, total %llu.%06llu s,"
+                                " avg %llu us, max %llu us\n",
+                                st->name, st->count,
+                                st->total / 1000000000ull,
+                                (st->total % 1000000000ull) / 1000,
+                                st->total / st->count / 1000,
+                                st->max / 1000);
+
+      /* The histogram lists the lower bound of each used bucket.  */
+      *line = 0;
+      for (n=0, i=0; i < TIMER_BUCKETS && n < sizeof line; i++)
+        if (st->hist[i])
+          n += snprintf (line + n, sizeof line - n, " %s%lu:%lu",
+                         i? "":"<", i? (1ul << (i-1)) : 1ul, st->hist[i]);
+      _gpgrt_log_debug_nolimit ("timer %s: usec%s\n", st->name, line);
+    }
+
+  release_stats (merged);
+}
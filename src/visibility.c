@@ -192,6 +192,12 @@ gpgrt_fopenmem_init (size_t memlimit, const char *_GPGRT__RESTRICT mode,
   return _gpgrt_fopenmem_init (memlimit, mode, data, datalen);
 }
 
+estream_t
+gpgrt_fopenmem_ro (const void *data, size_t datalen)
+{
+  return _gpgrt_fopenmem_ro (data, datalen);
+}
+
 estream_t
 gpgrt_fdopen (int filedes, const char *mode)
 {
@@ -459,6 +465,23 @@ gpgrt_write (estream_t _GPGRT__RESTRICT stream,
   return _gpgrt_write (stream, buffer, bytes_to_write, bytes_written);
 }
 
+int
+gpgrt_pread (estream_t _GPGRT__RESTRICT stream,
+             void *_GPGRT__RESTRICT buffer, size_t bytes_to_read,
+             gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_read)
+{
+  return _gpgrt_pread (stream, buffer, bytes_to_read, offset, bytes_read);
+}
+
+int
+gpgrt_pwrite (estream_t _GPGRT__RESTRICT stream,
+              const void *_GPGRT__RESTRICT buffer, size_t bytes_to_write,
+              gpgrt_off_t offset, size_t *_GPGRT__RESTRICT bytes_written)
+{
+  return _gpgrt_pwrite (stream, buffer, bytes_to_write, offset,
+                        bytes_written);
+}
+
 int
 gpgrt_write_sanitized (estream_t _GPGRT__RESTRICT stream,
                        const void * _GPGRT__RESTRICT buffer, size_t length,
@@ -969,6 +992,41 @@ gpgrt_add_post_log_func (void (*f)(int))
 }
 
 
+gpg_err_code_t
+gpgrt_log_set_async (unsigned int flags, unsigned int nrecords)
+{
+  return _gpgrt_log_set_async (flags, nrecords);
+}
+
+
+unsigned int
+gpgrt_log_set_level (unsigned int mask)
+{
+  return _gpgrt_log_set_level (mask);
+}
+
+
+int
+gpgrt_log_level_p (int level)
+{
+  return _gpgrt_log_level_p (level);
+}
+
+
+void
+gpgrt_log_set_rotate (size_t maxsize, unsigned int maxage, unsigned int nkeep)
+{
+  _gpgrt_log_set_rotate (maxsize, maxage, nkeep);
+}
+
+
+void
+gpgrt_log_set_ratelimit (unsigned int burst, unsigned int interval)
+{
+  _gpgrt_log_set_ratelimit (burst, interval);
+}
+
+
 void
 gpgrt_log (int level, const char *fmt, ...)
 {
@@ -1107,6 +1165,24 @@ gpgrt_log_clock (const char *fmt, ...)
   va_end (arg_ptr);
 }
 
+void
+gpgrt_timer_start (const char *name)
+{
+  _gpgrt_timer_start (name);
+}
+
+void
+gpgrt_timer_stop (const char *name)
+{
+  _gpgrt_timer_stop (name);
+}
+
+void
+gpgrt_timer_dump (int reset)
+{
+  _gpgrt_timer_dump (reset);
+}
+
 void
 _gpgrt_log_assert (const char *expr, const char *file,
                    int line, const char *func)
@@ -1371,6 +1447,13 @@ gpgrt_strlist_add (gpgrt_strlist_t *list, const char *string,
   return _gpgrt_strlist_add (list, string, flags);
 }
 
+gpgrt_strlist_t
+gpgrt_strlist_append (gpgrt_strlist_t *list, gpgrt_strlist_t *tailp,
+                      const char *string, unsigned int flags)
+{
+  return _gpgrt_strlist_append (list, tailp, string, flags);
+}
+
 gpgrt_strlist_t
 gpgrt_strlist_tokenize (gpgrt_strlist_t *list, const char *string,
                         const char *delim, unsigned int flags)
@@ -1414,6 +1497,48 @@ gpgrt_strlist_find (gpgrt_strlist_t haystack, const char *needle)
   return _gpgrt_strlist_find (haystack, needle);
 }
 
+gpgrt_strset_t
+gpgrt_strset_new (unsigned int flags)
+{
+  return _gpgrt_strset_new (flags);
+}
+
+void
+gpgrt_strset_release (gpgrt_strset_t set)
+{
+  _gpgrt_strset_release (set);
+}
+
+gpg_err_code_t
+gpgrt_strset_add (gpgrt_strset_t set, const char *string)
+{
+  return _gpgrt_strset_add (set, string);
+}
+
+int
+gpgrt_strset_contains (gpgrt_strset_t set, const char *string)
+{
+  return _gpgrt_strset_contains (set, string);
+}
+
+unsigned int
+gpgrt_strset_count (gpgrt_strset_t set)
+{
+  return _gpgrt_strset_count (set);
+}
+
+gpg_err_code_t
+gpgrt_strset_add_strlist (gpgrt_strset_t set, gpgrt_strlist_t list)
+{
+  return _gpgrt_strset_add_strlist (set, list);
+}
+
+gpg_err_code_t
+gpgrt_strset_to_strlist (gpgrt_strset_t set, gpgrt_strlist_t *r_list)
+{
+  return _gpgrt_strset_to_strlist (set, r_list);
+}
+
 
 
 gpgrt_nvc_t
@@ -1471,12 +1596,47 @@ gpgrt_nvc_parse (gpgrt_nvc_t *result, int *errlinep,
   return _gpgrt_nvc_parse (result, errlinep, stream, flags);
 }
 
+gpg_err_code_t
+gpgrt_nvc_parse_mem (gpgrt_nvc_t *result, int *errlinep,
+                     const void *buffer, size_t length, unsigned int flags)
+{
+  return _gpgrt_nvc_parse_mem (result, errlinep, buffer, length, flags);
+}
+
+gpg_err_code_t
+gpgrt_nvc_parse_files (gpgrt_nvc_t *results, gpg_err_code_t *errors,
+                       const char * const *fnames, int nfiles,
+                       unsigned int flags, int nthreads)
+{
+  return _gpgrt_nvc_parse_files (results, errors, fnames, nfiles,
+                                 flags, nthreads);
+}
+
 gpg_err_code_t
 gpgrt_nvc_write (gpgrt_nvc_t cont, estream_t stream)
 {
   return _gpgrt_nvc_write (cont, stream);
 }
 
+gpg_err_code_t
+gpgrt_nvc_update_file (gpgrt_nvc_t cont, const char *fname)
+{
+  return _gpgrt_nvc_update_file (cont, fname);
+}
+
+gpg_err_code_t
+gpgrt_nvc_save_binary (gpgrt_nvc_t cont, estream_t stream)
+{
+  return _gpgrt_nvc_save_binary (cont, stream);
+}
+
+gpg_err_code_t
+gpgrt_nvc_load_binary (gpgrt_nvc_t *result,
+                       const void *buffer, size_t length, unsigned int flags)
+{
+  return _gpgrt_nvc_load_binary (result, buffer, length, flags);
+}
+
 gpgrt_nve_t
 gpgrt_nve_next (gpgrt_nve_t entry, const char *name)
 {
@@ -70,6 +70,7 @@ MARK_VISIBLE (gpgrt_fopen)
 MARK_VISIBLE (gpgrt_mopen)
 MARK_VISIBLE (gpgrt_fopenmem)
 MARK_VISIBLE (gpgrt_fopenmem_init)
+MARK_VISIBLE (gpgrt_fopenmem_ro)
 MARK_VISIBLE (gpgrt_fdopen)
 MARK_VISIBLE (gpgrt_fdopen_nc)
 MARK_VISIBLE (gpgrt_sysopen)
@@ -113,6 +114,8 @@ MARK_VISIBLE (_gpgrt_putc_overflow)
 MARK_VISIBLE (gpgrt_ungetc)
 MARK_VISIBLE (gpgrt_read)
 MARK_VISIBLE (gpgrt_write)
+MARK_VISIBLE (gpgrt_pread)
+MARK_VISIBLE (gpgrt_pwrite)
 MARK_VISIBLE (gpgrt_write_sanitized)
 MARK_VISIBLE (gpgrt_write_hexstring)
 MARK_VISIBLE (gpgrt_fread)
@@ -185,6 +188,11 @@ MARK_VISIBLE (gpgrt_log_test_fd)
 MARK_VISIBLE (gpgrt_log_get_fd)
 MARK_VISIBLE (gpgrt_log_get_stream)
 MARK_VISIBLE (gpgrt_add_post_log_func)
+MARK_VISIBLE (gpgrt_log_set_async)
+MARK_VISIBLE (gpgrt_log_set_level)
+MARK_VISIBLE (gpgrt_log_set_rotate)
+MARK_VISIBLE (gpgrt_log_set_ratelimit)
+MARK_VISIBLE (gpgrt_log_level_p)
 MARK_VISIBLE (gpgrt_log)
 MARK_VISIBLE (gpgrt_logv)
 MARK_VISIBLE (gpgrt_logv_prefix)
@@ -199,6 +207,9 @@ MARK_VISIBLE (gpgrt_log_debug_string)
 MARK_VISIBLE (gpgrt_log_printf)
 MARK_VISIBLE (gpgrt_log_printhex)
 MARK_VISIBLE (gpgrt_log_clock)
+MARK_VISIBLE (gpgrt_timer_start)
+MARK_VISIBLE (gpgrt_timer_stop)
+MARK_VISIBLE (gpgrt_timer_dump)
 MARK_VISIBLE (gpgrt_log_flush)
 MARK_VISIBLE (_gpgrt_log_assert)
 
@@ -232,6 +243,7 @@ MARK_VISIBLE (gpgrt_fconcat)
 
 MARK_VISIBLE (gpgrt_strlist_free)
 MARK_VISIBLE (gpgrt_strlist_add)
+MARK_VISIBLE (gpgrt_strlist_append)
 MARK_VISIBLE (gpgrt_strlist_tokenize)
 MARK_VISIBLE (gpgrt_strlist_copy)
 MARK_VISIBLE (gpgrt_strlist_rev)
@@ -239,6 +251,13 @@ MARK_VISIBLE (gpgrt_strlist_prev)
 MARK_VISIBLE (gpgrt_strlist_last)
 MARK_VISIBLE (gpgrt_strlist_pop)
 MARK_VISIBLE (gpgrt_strlist_find)
+MARK_VISIBLE (gpgrt_strset_new)
+MARK_VISIBLE (gpgrt_strset_release)
+MARK_VISIBLE (gpgrt_strset_add)
+MARK_VISIBLE (gpgrt_strset_contains)
+MARK_VISIBLE (gpgrt_strset_count)
+MARK_VISIBLE (gpgrt_strset_add_strlist)
+MARK_VISIBLE (gpgrt_strset_to_strlist)
 
 MARK_VISIBLE (gpgrt_nvc_new)
 MARK_VISIBLE (gpgrt_nvc_release)
@@ -249,7 +268,12 @@ MARK_VISIBLE (gpgrt_nve_set)
 MARK_VISIBLE (gpgrt_nvc_delete)
 MARK_VISIBLE (gpgrt_nvc_lookup)
 MARK_VISIBLE (gpgrt_nvc_parse)
+MARK_VISIBLE (gpgrt_nvc_parse_mem)
+MARK_VISIBLE (gpgrt_nvc_parse_files)
 MARK_VISIBLE (gpgrt_nvc_write)
+MARK_VISIBLE (gpgrt_nvc_update_file)
+MARK_VISIBLE (gpgrt_nvc_save_binary)
+MARK_VISIBLE (gpgrt_nvc_load_binary)
 MARK_VISIBLE (gpgrt_nve_next)
 MARK_VISIBLE (gpgrt_nve_name)
 MARK_VISIBLE (gpgrt_nve_value)
@@ -304,6 +328,7 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_mopen                 _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_fopenmem              _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_fopenmem_init         _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_fopenmem_ro           _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_fdopen                _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_fdopen_nc             _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_sysopen               _gpgrt_USE_UNDERSCORED_FUNCTION
@@ -347,6 +372,8 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_ungetc                _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_read                  _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_write                 _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_pread                 _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_pwrite                _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_write_sanitized       _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_write_hexstring       _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_fread                 _gpgrt_USE_UNDERSCORED_FUNCTION
@@ -419,6 +446,11 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_log_get_fd            _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_log_get_stream        _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_add_post_log_func     _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_log_set_async         _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_log_set_level         _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_log_set_rotate        _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_log_set_ratelimit     _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_log_level_p           _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_log                   _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_logv                  _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_logv_prefix           _gpgrt_USE_UNDERSCORED_FUNCTION
@@ -433,6 +465,9 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_log_printf            _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_log_printhex          _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_log_clock             _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_timer_start           _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_timer_stop            _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_timer_dump            _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_log_flush             _gpgrt_USE_UNDERSCORED_FUNCTION
 #define _gpgrt_log_assert           _gpgrt_USE_UNDERSCORED_FUNCTION
 
@@ -479,6 +514,7 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 
 #define gpgrt_strlist_free          _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_add           _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strlist_append        _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_tokenize      _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_copy          _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_rev           _gpgrt_USE_UNDERSCORED_FUNCTION
@@ -486,6 +522,13 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_strlist_last          _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_pop           _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_strlist_find          _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_new            _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_release        _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_add            _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_contains       _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_count          _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_add_strlist    _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_strset_to_strlist     _gpgrt_USE_UNDERSCORED_FUNCTION
 
 #define gpgrt_nvc_new               _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nvc_release           _gpgrt_USE_UNDERSCORED_FUNCTION
@@ -496,7 +539,12 @@ MARK_VISIBLE (gpgrt_spawn_actions_set_atfork)
 #define gpgrt_nvc_delete            _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nvc_lookup            _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nvc_parse             _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_nvc_parse_mem         _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_nvc_parse_files       _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nvc_write             _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_nvc_update_file       _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_nvc_save_binary       _gpgrt_USE_UNDERSCORED_FUNCTION
+#define gpgrt_nvc_load_binary       _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nve_next              _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nve_name              _gpgrt_USE_UNDERSCORED_FUNCTION
 #define gpgrt_nve_value             _gpgrt_USE_UNDERSCORED_FUNCTION
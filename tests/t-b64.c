@@ -262,6 +262,99 @@ encoder_tests (void)
 }
 
 
+/* Encode BUFFER of LENGTH by writes of at most CHUNK bytes and return
+ * the result as a malloced string.  */
+static char *
+encode_chunked (const unsigned char *buffer, size_t length, size_t chunk,
+                const char *title)
+{
+  gpg_err_code_t err;
+  estream_t fp;
+  gpgrt_b64state_t state;
+  size_t n;
+  char *result;
+
+  fp = es_fopenmem (0, "rwb");
+  if (!fp)
+    die ("es_fopenmem failed: %s\n", gpg_strerror (gpg_error_from_syserror ()));
+
+  state = gpgrt_b64enc_start (fp, title);
+  if (!state)
+    die ("gpgrt_b64enc_start failed: %s\n",
+         gpg_strerror (gpg_error_from_syserror ()));
+  for (; length; buffer += n, length -= n)
+    {
+      n = length < chunk? length : chunk;
+      err = gpgrt_b64enc_write (state, buffer, n);
+      if (err)
+        die ("gpgrt_b64enc_write failed: %s\n", gpg_strerror (err));
+    }
+  err = gpgrt_b64enc_finish (state);
+  if (err)
+    die ("gpgrt_b64enc_finish failed: %s\n", gpg_strerror (err));
+
+  es_fputc (0, fp);
+  if (es_fclose_snatch (fp, (void**)&result, NULL))
+    die ("es_fclose_snatch failed: %s\n",
+         gpg_strerror (gpg_error_from_syserror ()));
+  return result;
+}
+
+
+/* Check that the encoding of a large buffer does not depend on the
+ * size of the writes and that it decodes to the original data.  */
+static void
+chunked_tests (void)
+{
+  static size_t chunks[] = { 1, 2, 4, 47, 48, 49, 1000, 5000 };
+  static const char *titles[] = { NULL, "", "PGP MESSAGE" };
+  unsigned char data[5000];
+  char *ref, *result;
+  gpgrt_b64state_t state;
+  gpg_error_t err;
+  size_t i, t, len;
+
+  if (verbose)
+    show ("running chunked encoder tests\n");
+
+  for (i=0; i < sizeof data; i++)
+    data[i] = (i * 7 + (i >> 8)) & 0xff;
+
+  for (t=0; t < DIM (titles); t++)
+    {
+      ref = encode_chunked (data, sizeof data, sizeof data, titles[t]);
+      for (i=0; i < DIM (chunks); i++)
+        {
+          result = encode_chunked (data, sizeof data, chunks[i], titles[t]);
+          if (strcmp (result, ref))
+            fail ("chunked encoder test %zu/%zu failed\n", t, i);
+          es_free (result);
+        }
+
+      if (!titles[t])
+        {
+          /* Check the line length and decode it again.  */
+          for (i=0; ref[i]; i += 65)
+            if (strlen (ref + i) > 64 && ref[i + 64] != '\n')
+              fail ("chunked encoder test %zu: bad line length\n", t);
+          state = gpgrt_b64dec_start (NULL);
+          if (!state)
+            die ("gpgrt_b64dec_start failed\n");
+          len = 0;
+          err = gpgrt_b64dec_proc (state, ref, strlen (ref), &len);
+          if (err && gpg_err_code (err) != GPG_ERR_EOF)
+            fail ("chunked decoder test failed: %s\n", gpg_strerror (err));
+          err = gpgrt_b64dec_finish (state);
+          if (err)
+            fail ("chunked decoder test failed: %s\n", gpg_strerror (err));
+          if (len != sizeof data || memcmp (ref, data, len))
+            fail ("chunked decoder test: data mismatch\n");
+        }
+      es_free (ref);
+    }
+}
+
+
 static void
 decoder_tests (void)
 {
@@ -369,6 +462,7 @@ main (int argc, char **argv)
     }
 
   encoder_tests ();
+  chunked_tests ();
   decoder_tests ();
   extra_tests ();
 
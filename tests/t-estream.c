@@ -0,0 +1,421 @@
+/* t-estream.c - Check some estream functions
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of Libgpg-error.
+ *
+ * Libgpg-error is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgpg-error is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define PGM "t-estream"
+#include "t-common.h"
+
+
+static const char test_data[] =
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+
+static const char *
+my_strusage (int level)
+{
+  const char *p;
+
+  switch (level)
+    {
+    case 9: p = "LGPL-2.1-or-later"; break;
+    case 11: p = PGM; break;
+    default: p = NULL;
+    }
+  return p;
+}
+
+
+/* Return a stream for a temporary file with TEST_DATA as content.
+ * The file position is set to the start.  FP receives the stdio
+ * object which needs to be closed after the stream.  */
+static gpgrt_stream_t
+open_tmp_stream (FILE **r_fp)
+{
+  gpgrt_stream_t stream;
+  FILE *fp;
+
+  fp = tmpfile ();
+  if (!fp)
+    die ("tmpfile failed: %s\n", strerror (errno));
+  stream = gpgrt_fdopen_nc (fileno (fp), "r+b");
+  if (!stream)
+    die ("fdopen failed: %s\n", strerror (errno));
+  if (gpgrt_fwrite (test_data, strlen (test_data), 1, stream) != 1
+      || gpgrt_fflush (stream))
+    die ("writing test data failed: %s\n", strerror (errno));
+  gpgrt_rewind (stream);
+  *r_fp = fp;
+  return stream;
+}
+
+
+static void
+check_pread_pwrite (void)
+{
+  gpgrt_stream_t stream;
+  FILE *fp;
+  char buffer[100];
+  size_t nbytes;
+  int c;
+
+  enter_test_function ();
+
+  stream = open_tmp_stream (&fp);
+
+  /* Read one byte so that the stream's buffer is filled.  */
+  c = gpgrt_fgetc (stream);
+  if (c != '0')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+
+  if (gpgrt_pread (stream, buffer, 4, 36, &nbytes))
+    fail ("pread failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 4 || memcmp (buffer, "ABCD", 4))
+    fail ("pread returned wrong data at line %d", __LINE__);
+
+  /* Short read at the end of the file.  */
+  if (gpgrt_pread (stream, buffer, sizeof buffer, 60, &nbytes))
+    fail ("pread failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 2 || memcmp (buffer, "YZ", 2))
+    fail ("pread returned wrong data at line %d", __LINE__);
+
+  /* Read beyond the end of the file.  */
+  if (gpgrt_pread (stream, buffer, sizeof buffer, 1000, &nbytes))
+    fail ("pread failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes)
+    fail ("pread returned data at line %d", __LINE__);
+
+  if (gpgrt_pwrite (stream, "XY", 2, 10, &nbytes))
+    fail ("pwrite failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 2)
+    fail ("pwrite wrote %d bytes at line %d", (int)nbytes, __LINE__);
+  if (gpgrt_pread (stream, buffer, 4, 9, &nbytes))
+    fail ("pread failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 4 || memcmp (buffer, "9XYc", 4))
+    fail ("pread returned wrong data at line %d", __LINE__);
+
+  /* The normal stream position is not affected.  */
+  if (gpgrt_ftello (stream) != 1)
+    fail ("stream position changed at line %d", __LINE__);
+  c = gpgrt_fgetc (stream);
+  if (c != '1')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+
+  /* But the buffered data has been updated.  */
+  if (gpgrt_read (stream, buffer, 10, &nbytes))
+    fail ("read failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 10 || memcmp (buffer, "23456789XY", 10))
+    fail ("read returned wrong data at line %d", __LINE__);
+
+  gpgrt_fclose (stream);
+  fclose (fp);
+
+  /* The same for a stdio based stream.  */
+  fp = tmpfile ();
+  if (!fp)
+    die ("tmpfile failed: %s\n", strerror (errno));
+  if (fputs (test_data, fp) == EOF || fflush (fp))
+    die ("writing test data failed: %s\n", strerror (errno));
+  rewind (fp);
+  stream = gpgrt_fpopen_nc (fp, "r+b");
+  if (!stream)
+    die ("fpopen failed: %s\n", strerror (errno));
+  c = gpgrt_fgetc (stream);
+  if (c != '0')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (gpgrt_pread (stream, buffer, 4, 36, &nbytes))
+    fail ("pread failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 4 || memcmp (buffer, "ABCD", 4))
+    fail ("pread returned wrong data at line %d", __LINE__);
+  if (gpgrt_pwrite (stream, "XY", 2, 10, &nbytes))
+    fail ("pwrite failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 2)
+    fail ("pwrite wrote %d bytes at line %d", (int)nbytes, __LINE__);
+  if (gpgrt_read (stream, buffer, 11, &nbytes))
+    fail ("read failed at line %d: %s", __LINE__, strerror (errno));
+  else if (nbytes != 11 || memcmp (buffer, "123456789XY", 11))
+    fail ("read returned wrong data at line %d", __LINE__);
+  gpgrt_fclose (stream);
+  fclose (fp);
+
+  /* Memory streams do not support this.  */
+  stream = gpgrt_fopenmem (0, "w+b");
+  if (!stream)
+    die ("fopenmem failed: %s\n", strerror (errno));
+  if (!gpgrt_pread (stream, buffer, 4, 0, &nbytes))
+    fail ("pread on a memory stream did not fail");
+  gpgrt_fclose (stream);
+
+  leave_test_function ();
+}
+
+
+/* A cookie for a read-only memory object which counts the calls of
+ * the cookie functions.  */
+struct counting_cookie_s
+{
+  const char *data;
+  size_t datalen;
+  size_t offset;
+  int nreads;
+  int nseeks;
+};
+
+static gpgrt_ssize_t
+counting_read (void *cookie, void *buffer, size_t size)
+{
+  struct counting_cookie_s *cc = cookie;
+
+  if (!size)
+    return -1;
+  cc->nreads++;
+  if (size > cc->datalen - cc->offset)
+    size = cc->datalen - cc->offset;
+  memcpy (buffer, cc->data + cc->offset, size);
+  cc->offset += size;
+  return size;
+}
+
+static int
+counting_seek (void *cookie, gpgrt_off_t *offset, int whence)
+{
+  struct counting_cookie_s *cc = cookie;
+  gpgrt_off_t pos;
+
+  cc->nseeks++;
+  if (whence == SEEK_SET)
+    pos = *offset;
+  else if (whence == SEEK_CUR)
+    pos = cc->offset + *offset;
+  else
+    pos = cc->datalen + *offset;
+  if (pos < 0 || pos > cc->datalen)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  cc->offset = pos;
+  *offset = pos;
+  return 0;
+}
+
+
+static void
+check_seek_in_buffer (void)
+{
+  static gpgrt_cookie_io_functions_t funcs =
+    { counting_read, NULL, counting_seek, NULL };
+  struct counting_cookie_s cc;
+  gpgrt_stream_t stream;
+  char buffer[10];
+  int c;
+
+  enter_test_function ();
+
+  memset (&cc, 0, sizeof cc);
+  cc.data = test_data;
+  cc.datalen = strlen (test_data);
+  stream = gpgrt_fopencookie (&cc, "r", funcs);
+  if (!stream)
+    die ("fopencookie failed: %s\n", strerror (errno));
+
+  c = gpgrt_fgetc (stream);
+  if (c != '0' || cc.nreads != 1)
+    fail ("fgetc failed at line %d", __LINE__);
+
+  /* Small relative seeks are done within the buffer.  */
+  if (gpgrt_fseek (stream, 9, SEEK_CUR))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  c = gpgrt_fgetc (stream);
+  if (c != 'a')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (gpgrt_fseek (stream, -5, SEEK_CUR))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_ftell (stream) != 6)
+    fail ("ftell returned wrong value at line %d", __LINE__);
+  c = gpgrt_fgetc (stream);
+  if (c != '6')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (cc.nseeks || cc.nreads != 1)
+    fail ("cookie functions called at line %d (%d,%d)",
+          __LINE__, cc.nseeks, cc.nreads);
+
+  /* Seeking before the buffer requires a real seek which fails
+   * here.  */
+  if (gpgrt_fseek (stream, -10, SEEK_CUR) == 0)
+    fail ("fseek did not fail at line %d", __LINE__);
+  gpgrt_clearerr (stream);
+
+  /* An absolute seek is done the first time by the cookie function
+   * and then within the buffer.  */
+  if (gpgrt_fseek (stream, 20, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_fread (buffer, 3, 1, stream) != 1 || memcmp (buffer, "klm", 3))
+    fail ("fread failed at line %d", __LINE__);
+  if (gpgrt_fseek (stream, 24, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_fread (buffer, 2, 1, stream) != 1 || memcmp (buffer, "op", 2))
+    fail ("fread failed at line %d", __LINE__);
+  if (gpgrt_fseek (stream, 21, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  c = gpgrt_fgetc (stream);
+  if (c != 'l')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (cc.nseeks != 2 || cc.nreads != 2)
+    fail ("cookie functions called at line %d (%d,%d)",
+          __LINE__, cc.nseeks, cc.nreads);
+
+  /* Seeking to the end of the buffered data works and reading then
+   * returns EOF.  This empties the buffer and thus the next seek
+   * needs to call the cookie function.  */
+  if (gpgrt_fseek (stream, 62, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  c = gpgrt_fgetc (stream);
+  if (c != EOF || !gpgrt_feof (stream))
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (gpgrt_fseek (stream, 61, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  c = gpgrt_fgetc (stream);
+  if (c != 'Z')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+  if (cc.nseeks != 3)
+    fail ("cookie functions called at line %d (%d,%d)",
+          __LINE__, cc.nseeks, cc.nreads);
+
+  gpgrt_fclose (stream);
+
+  leave_test_function ();
+}
+
+
+static void
+check_fopenmem_ro (void)
+{
+  gpgrt_stream_t stream;
+  char data[sizeof test_data];
+  char buffer[100];
+  size_t nbytes;
+  int c;
+
+  enter_test_function ();
+
+  memcpy (data, test_data, sizeof data);
+  stream = gpgrt_fopenmem_ro (data, strlen (data));
+  if (!stream)
+    die ("fopenmem_ro failed: %s\n", strerror (errno));
+
+  if (gpgrt_read (stream, buffer, 10, &nbytes) || nbytes != 10
+      || memcmp (buffer, "0123456789", 10))
+    fail ("read failed at line %d", __LINE__);
+  c = gpgrt_fgetc (stream);
+  if (c != 'a')
+    fail ("fgetc returned %d at line %d", c, __LINE__);
+
+  /* Writing is not possible and does not change the data.  */
+  if (gpgrt_fputc ('x', stream) != EOF)
+    fail ("fputc did not fail at line %d", __LINE__);
+  if (gpgrt_fwrite ("xyz", 3, 1, stream) == 1)
+    fail ("fwrite did not fail at line %d", __LINE__);
+  if (memcmp (data, test_data, sizeof data))
+    fail ("data has been modified at line %d", __LINE__);
+  gpgrt_clearerr (stream);
+
+  if (gpgrt_fseek (stream, -2, SEEK_END))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_read (stream, buffer, sizeof buffer, &nbytes) || nbytes != 2
+      || memcmp (buffer, "YZ", 2))
+    fail ("read failed at line %d", __LINE__);
+  if (gpgrt_fgetc (stream) != EOF || !gpgrt_feof (stream))
+    fail ("EOF not detected at line %d", __LINE__);
+
+  gpgrt_rewind (stream);
+  if (!gpgrt_fgets (buffer, 5, stream) || strcmp (buffer, "0123"))
+    fail ("fgets failed at line %d", __LINE__);
+  if (gpgrt_fseek (stream, 100, SEEK_SET) == 0)
+    fail ("fseek did not fail at line %d", __LINE__);
+
+  /* Also check unbuffered mode.  */
+  gpgrt_clearerr (stream);
+  if (gpgrt_setvbuf (stream, NULL, _IONBF, 0))
+    fail ("setvbuf failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_fseek (stream, 36, SEEK_SET))
+    fail ("fseek failed at line %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_read (stream, buffer, 3, &nbytes) || nbytes != 3
+      || memcmp (buffer, "ABC", 3))
+    fail ("read failed at line %d", __LINE__);
+  if (gpgrt_ftell (stream) != 39)
+    fail ("ftell returned wrong value at line %d", __LINE__);
+
+  gpgrt_fclose (stream);
+  if (memcmp (data, test_data, sizeof data))
+    fail ("data has been modified at line %d", __LINE__);
+
+  /* An empty object.  */
+  stream = gpgrt_fopenmem_ro (NULL, 0);
+  if (!stream)
+    die ("fopenmem_ro failed: %s\n", strerror (errno));
+  if (gpgrt_fgetc (stream) != EOF || !gpgrt_feof (stream))
+    fail ("EOF not detected at line %d", __LINE__);
+  gpgrt_fclose (stream);
+
+  leave_test_function ();
+}
+
+
+int
+main (int argc, char **argv)
+{
+  gpgrt_opt_t opts[] = {
+    ARGPARSE_x  ('v', "verbose", NONE, 0, "Print more diagnostics"),
+    ARGPARSE_s_n('d', "debug", "Flyswatter"),
+    ARGPARSE_end()
+  };
+  gpgrt_argparse_t pargs = { &argc, &argv, 0 };
+
+  gpgrt_set_strusage (my_strusage);
+  gpgrt_log_set_prefix (gpgrt_strusage (11), GPGRT_LOG_WITH_PREFIX);
+
+  while (gpgrt_argparse  (NULL, &pargs, opts))
+    {
+      switch (pargs.r_opt)
+        {
+        case 'v': verbose++; break;
+        case 'd': debug++; break;
+        default : pargs.err = ARGPARSE_PRINT_ERROR; break;
+	}
+    }
+  gpgrt_argparse (NULL, &pargs, NULL);
+
+  show ("testing estream functions\n");
+
+  check_pread_pwrite ();
+  check_seek_in_buffer ();
+  check_fopenmem_ro ();
+
+  show ("testing estream functions finished\n");
+  return !!errorcount;
+}
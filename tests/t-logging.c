@@ -27,6 +27,16 @@
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
+#ifndef HAVE_W32_SYSTEM
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <sys/wait.h>
+# include <sys/stat.h>
+#endif
+#if USE_POSIX_THREADS && !USE_POSIX_THREADS_WEAK
+# include <pthread.h>
+# define HAVE_THREAD_TESTS 1
+#endif
 
 #define PGM "t-logging"
 #include "t-common.h"
@@ -81,7 +91,7 @@ log_to_string (void)
       buflen += nread;
     }
   while (nread == NCHUNK);
-  buffer[nread] = 0;
+  buffer[buflen] = 0;
 
   if (strlen (buffer) != buflen)
     fail ("stream_to_string detected an embedded nul");
@@ -183,6 +193,64 @@ check_with_pid (void)
 }
 
 
+/* Check that the log line in LOGBUF starts with a timestamp matching
+ * TEMPLATE where a '9' stands for a digit.  */
+static int
+timestamp_matches (const char *logbuf, const char *template)
+{
+  for (; *template; template++, logbuf++)
+    {
+      if (*template == '9')
+        {
+          if (!(*logbuf >= '0' && *logbuf <= '9'))
+            return 0;
+        }
+      else if (*logbuf != *template)
+        return 0;
+    }
+  return 1;
+}
+
+
+static void
+check_with_time (void)
+{
+  static struct {
+    unsigned int flags;
+    const char *template;
+  } tests[] = {
+    { 0,                   "9999-99-99 99:99:99 " },
+    { GPGRT_LOG_TIME_MSEC, "9999-99-99T99:99:99.999 " },
+    { GPGRT_LOG_TIME_USEC, "9999-99-99T99:99:99.999999 " }
+  };
+  unsigned int flags;
+  char *logbuf;
+  int idx, i;
+
+  for (idx=0; idx < DIM (tests); idx++)
+    {
+      gpgrt_log_set_prefix (NULL, (GPGRT_LOG_WITH_PREFIX|GPGRT_LOG_WITH_TIME
+                                   | tests[idx].flags));
+      gpgrt_log_get_prefix (&flags);
+      if (flags != (GPGRT_LOG_WITH_PREFIX|GPGRT_LOG_WITH_TIME
+                    | tests[idx].flags))
+        fail ("log_with_time test %d failed at line %d\n", idx, __LINE__);
+
+      /* Log twice to also exercise the cached date.  */
+      for (i=0; i < 2; i++)
+        {
+          log_info ("first log\n");
+          logbuf = log_to_string ();
+          if (!timestamp_matches (logbuf, tests[idx].template)
+              || strcmp (logbuf + strlen (tests[idx].template),
+                         "t-logging first log\n"))
+            fail ("log_with_time test %d failed at line %d\n", idx, __LINE__);
+          free (logbuf);
+        }
+    }
+}
+
+
 static void
 check_log_error (void)
 {
@@ -207,6 +275,785 @@ check_log_error (void)
 }
 
 
+#ifdef HAVE_THREAD_TESTS
+static void *
+suppressed_thread (void *arg)
+{
+  (void)arg;
+  log_debug ("suppressed in thread\n");
+  return NULL;
+}
+#endif
+
+
+static void
+check_log_level (void)
+{
+  unsigned int oldmask;
+  char *logbuf;
+  unsigned char buffer[4] = { 1, 2, 3, 4 };
+
+  oldmask = gpgrt_log_set_level (~GPGRT_LOGLVL_BIT (GPGRT_LOGLVL_DEBUG));
+  if (oldmask != ~0u)
+    fail ("log_level test failed at line %d\n", __LINE__);
+  if (gpgrt_log_level_p (GPGRT_LOGLVL_DEBUG)
+      || !gpgrt_log_level_p (GPGRT_LOGLVL_INFO)
+      || !gpgrt_log_level_p (GPGRT_LOGLVL_FATAL))
+    fail ("log_level test failed at line %d\n", __LINE__);
+
+  /* The continuation of a suppressed record is suppressed too.  */
+  log_debug ("suppressed");
+  log_printf (" and its continuation\n");
+  log_printhex (buffer, sizeof buffer, "dump:");
+  log_info ("shown");
+  log_printf (" with continuation\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, "t-logging: shown with continuation\n"))
+    fail ("log_level test failed at line %d\n", __LINE__);
+  free (logbuf);
+
+#ifdef HAVE_THREAD_TESTS
+  /* A record suppressed by another thread does not hide the
+   * continuation of this thread.  */
+  {
+    pthread_t thread;
+
+    log_info ("shown");
+    if (pthread_create (&thread, NULL, suppressed_thread, NULL))
+      fail ("log_level test failed at line %d\n", __LINE__);
+    else
+      pthread_join (thread, NULL);
+    log_printf (" with continuation\n");
+    logbuf = log_to_string ();
+    if (strcmp (logbuf, "t-logging: shown with continuation\n"))
+      fail ("log_level test failed at line %d\n", __LINE__);
+    free (logbuf);
+  }
+#endif /*HAVE_THREAD_TESTS*/
+
+  /* Suppressed errors are still counted.  */
+  gpgrt_log_set_level (0);
+  log_error ("suppressed error\n");
+  logbuf = log_to_string ();
+  if (*logbuf)
+    fail ("log_level test failed at line %d\n", __LINE__);
+  free (logbuf);
+  if (log_get_errorcount (1) != 1)
+    fail ("log_level test failed at line %d\n", __LINE__);
+
+  gpgrt_log_set_level (oldmask);
+}
+
+
+static void
+check_log_printhex (void)
+{
+  unsigned char buffer[40];
+  char *logbuf;
+  int i;
+
+  for (i=0; i < DIM (buffer); i++)
+    buffer[i] = i;
+
+  log_printhex (buffer, 3, NULL);
+  log_printf ("\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, "000102\n"))
+    fail ("log_printhex test failed at line %d\n", __LINE__);
+  free (logbuf);
+
+  log_printhex (buffer, DIM (buffer), "foo:");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf,
+              "t-logging: DBG: foo: "
+              "000102030405060708090a0b0c0d0e0f"
+              "101112131415161718191a1b1c1d1e1f \\\n"
+              "t-logging: DBG:      2021222324252627\n"))
+    fail ("log_printhex test failed at line %d\n", __LINE__);
+  free (logbuf);
+
+  log_printhex (buffer, DIM (buffer), "|!trunc|foo:");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf,
+              "t-logging: DBG: foo: "
+              "000102030405060708090a0b0c0d0e0f"
+              "101112131415161718191a1b1c1d1e1f …\n"))
+    fail ("log_printhex test failed at line %d\n", __LINE__);
+  free (logbuf);
+}
+
+
+static int
+my_pid_suffix (unsigned long *r_value)
+{
+  *r_value = 42;
+  return 1;
+}
+
+
+static void
+check_log_json (void)
+{
+  char *logbuf, *p;
+  char expected[200];
+  int pid = (int)getpid ();
+
+  gpgrt_log_set_prefix (NULL, (GPGRT_LOG_WITH_PREFIX|GPGRT_LOG_WITH_TIME
+                               |GPGRT_LOG_WITH_PID|GPGRT_LOG_JSON
+                               |GPGRT_LOG_TIME_MSEC));
+  log_info ("a \"quoted\"\ttab\n");
+  logbuf = log_to_string ();
+  snprintf (expected, sizeof expected,
+            "\",\"pid\":%d,\"level\":\"info\",\"prefix\":\"t-logging\","
+            "\"msg\":\"a \\\"quoted\\\"\\ttab\"}\n", pid);
+  if (!timestamp_matches (logbuf, "{\"time\":\"9999-99-99T99:99:99.999Z")
+      || !(p = strchr (logbuf + 9, '"')) || strcmp (p, expected))
+    fail ("log_json test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  log_error ("ctrl\x01 %s/", "back\\slash\nnewline");
+  logbuf = log_to_string ();
+  snprintf (expected, sizeof expected,
+            "\",\"pid\":%d,\"level\":\"error\",\"prefix\":\"t-logging\","
+            "\"msg\":\"ctrl\\u0001 back\\\\slash\\nnewline/\"}\n", pid);
+  if (!timestamp_matches (logbuf, "{\"time\":\"9999-99-99T99:99:99.999Z")
+      || !(p = strchr (logbuf + 9, '"')) || strcmp (p, expected))
+    fail ("log_json test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* Valid UTF-8 is copied; other bytes with the high bit set are
+   * escaped.  */
+  log_info ("utf8 \xc3\xa4 bad \xff \xc3( \xed\xa0\x80 \xe2\x82");
+  logbuf = log_to_string ();
+  snprintf (expected, sizeof expected,
+            "\",\"pid\":%d,\"level\":\"info\",\"prefix\":\"t-logging\","
+            "\"msg\":\"utf8 \xc3\xa4 bad \\u00ff \\u00c3("
+            " \\u00ed\\u00a0\\u0080 \\u00e2\\u0082\"}\n", pid);
+  if (!timestamp_matches (logbuf, "{\"time\":\"9999-99-99T99:99:99.999Z")
+      || !(p = strchr (logbuf + 9, '"')) || strcmp (p, expected))
+    fail ("log_json test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* The pid suffix is given as a separate field.  */
+  gpgrt_log_set_pid_suffix_cb (my_pid_suffix);
+  log_info ("suffix\n");
+  gpgrt_log_set_pid_suffix_cb (NULL);
+  logbuf = log_to_string ();
+  snprintf (expected, sizeof expected,
+            "\",\"pid\":%d,\"pidsuffix\":\"42\",\"level\":\"info\","
+            "\"prefix\":\"t-logging\",\"msg\":\"suffix\"}\n", pid);
+  if (!timestamp_matches (logbuf, "{\"time\":\"9999-99-99T99:99:99.999Z")
+      || !(p = strchr (logbuf + 9, '"')) || strcmp (p, expected))
+    fail ("log_json test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* Without the flags there is no time, pid and prefix.  */
+  gpgrt_log_set_prefix (NULL, GPGRT_LOG_JSON);
+  log_info ("plain\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, "{\"level\":\"info\",\"msg\":\"plain\"}\n"))
+    fail ("log_json test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  gpgrt_log_set_prefix (NULL, GPGRT_LOG_WITH_PREFIX);
+}
+
+
+static void
+log_flood (int i)
+{
+  log_info ("flood %d\n", i);
+}
+
+static void
+check_log_ratelimit (void)
+{
+  char *logbuf;
+  int i;
+
+  gpgrt_log_set_ratelimit (2, 1);
+  for (i=0; i < 5; i++)
+    log_flood (i);
+  log_info ("other\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, ("t-logging: flood 0\n"
+                       "t-logging: flood 1\n"
+                       "t-logging: other\n")))
+    fail ("log_ratelimit test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* Wait for the next interval.  */
+  sleep (2);
+  log_flood (5);
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, ("t-logging: last message repeated 3 times\n"
+                       "t-logging: flood 5\n")))
+    fail ("log_ratelimit test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* The lines of a hexdump are not subject to the rate limit.  */
+  {
+    unsigned char buffer[128];
+
+    for (i=0; i < DIM (buffer); i++)
+      buffer[i] = i;
+    log_printhex (buffer, DIM (buffer), "dump:");
+    logbuf = log_to_string ();
+    if (strcmp (logbuf,
+                "t-logging: DBG: dump: "
+                "000102030405060708090a0b0c0d0e0f"
+                "101112131415161718191a1b1c1d1e1f \\\n"
+                "t-logging: DBG:       "
+                "202122232425262728292a2b2c2d2e2f"
+                "303132333435363738393a3b3c3d3e3f \\\n"
+                "t-logging: DBG:       "
+                "404142434445464748494a4b4c4d4e4f"
+                "505152535455565758595a5b5c5d5e5f \\\n"
+                "t-logging: DBG:       "
+                "606162636465666768696a6b6c6d6e6f"
+                "707172737475767778797a7b7c7d7e7f\n"))
+      fail ("log_ratelimit test failed at line %d: '%s'\n", __LINE__, logbuf);
+    free (logbuf);
+  }
+
+  /* Pending summaries are written when the rate limit changes.  */
+  for (i=6; i < 9; i++)
+    log_flood (i);
+  gpgrt_log_set_ratelimit (0, 0);
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, ("t-logging: flood 6\n"
+                       "t-logging: last message repeated 2 times\n")))
+    fail ("log_ratelimit test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  for (i=0; i < 3; i++)
+    log_flood (i);
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, ("t-logging: flood 0\n"
+                       "t-logging: flood 1\n"
+                       "t-logging: flood 2\n")))
+    fail ("log_ratelimit test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+}
+
+
+static void
+check_timer (void)
+{
+  char *logbuf, *p;
+  char name[10];
+  unsigned long calls, n, total;
+  int i;
+
+  for (i=0; i < 3; i++)
+    {
+      gpgrt_timer_start ("t-timer");
+      gpgrt_timer_stop ("t-timer");
+    }
+  gpgrt_timer_stop ("t-timer");   /* Not running - ignored.  */
+  gpgrt_timer_stop ("t-unknown"); /* Never started - ignored.  */
+  gpgrt_timer_dump (1);
+
+  logbuf = log_to_string ();
+  if (sscanf (logbuf, "t-logging: DBG: timer t-timer: %lu calls,", &calls) != 1
+      || calls != 3)
+    fail ("timer test failed at line %d: '%s'\n", __LINE__, logbuf);
+  p = strchr (logbuf, '\n');
+  if (!p || strncmp (p+1, "t-logging: DBG: timer t-timer: usec ", 36))
+    fail ("timer test failed at line %d: '%s'\n", __LINE__, logbuf);
+  else
+    {
+      /* The histogram must account for all calls.  */
+      total = 0;
+      for (p += 36; *p && *p != '\n'; p++)
+        if (*p == ':' && sscanf (p+1, "%lu", &n) == 1)
+          total += n;
+      if (total != 3)
+        fail ("timer test failed at line %d: '%s'\n", __LINE__, logbuf);
+    }
+  free (logbuf);
+
+  /* After the reset nothing is to be reported.  */
+  gpgrt_timer_dump (0);
+  logbuf = log_to_string ();
+  if (*logbuf)
+    fail ("timer test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+
+  /* Nested timers and names at different addresses.  */
+  strcpy (name, "t-timer");
+  gpgrt_timer_start ("t-timer");
+  gpgrt_timer_start ("t-inner");
+  gpgrt_timer_stop ("t-inner");
+  gpgrt_timer_stop (name);
+  gpgrt_timer_start (name);
+  gpgrt_timer_stop ("t-timer");
+  gpgrt_timer_dump (1);
+  logbuf = log_to_string ();
+  if (!strstr (logbuf, "DBG: timer t-timer: 2 calls,")
+      || !strstr (logbuf, "DBG: timer t-inner: 1 calls,"))
+    fail ("timer test failed at line %d: '%s'\n", __LINE__, logbuf);
+  free (logbuf);
+}
+
+
+static void
+check_log_async (void)
+{
+  gpg_err_code_t ec;
+  char *logbuf, *p;
+  int i, n;
+
+  ec = gpgrt_log_set_async (GPGRT_LOG_ASYNC_BLOCK, 4);
+  if (ec == GPG_ERR_NOT_SUPPORTED)
+    {
+      show ("async logging not supported - skipped\n");
+      return;
+    }
+  if (ec)
+    {
+      fail ("gpgrt_log_set_async failed: %s\n", gpg_strerror (ec));
+      return;
+    }
+
+  /* With a blocking queue all records must arrive in order even if
+   * the queue is much smaller than the number of records.  */
+  for (i=0; i < 100; i++)
+    log_info ("async record %d\n", i);
+  logbuf = log_to_string ();
+  for (p = logbuf, i=0; i < 100; i++)
+    {
+      if (sscanf (p, "t-logging: async record %d\n", &n) != 1 || n != i)
+        {
+          fail ("log_async test failed at line %d (record %d)\n",
+                __LINE__, i);
+          break;
+        }
+      p = strchr (p, '\n');
+      if (!p)
+        break;
+      p++;
+    }
+  if (p && *p)
+    fail ("log_async test failed at line %d\n", __LINE__);
+  free (logbuf);
+
+  /* A missing LF is still inserted before the next record.  */
+  log_info ("first");
+  log_printf (" more");
+  log_info ("second\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, "t-logging: first more\nt-logging: second\n"))
+    fail ("log_async test failed at line %d\n", __LINE__);
+  free (logbuf);
+
+#ifndef HAVE_W32_SYSTEM
+  /* A child forked while the writer is busy must be able to log.  */
+  {
+    pid_t pid;
+    int status;
+
+    for (i=0; i < 20; i++)
+      log_info ("async record %d\n", i);
+    pid = fork ();
+    if (pid == (pid_t)(-1))
+      fail ("log_async test failed at line %d\n", __LINE__);
+    else if (!pid)
+      {
+        alarm (10);
+        log_info ("child record\n");
+        _exit (0);
+      }
+    else if (waitpid (pid, &status, 0) != pid
+             || !WIFEXITED (status) || WEXITSTATUS (status))
+      fail ("log_async test failed at line %d\n", __LINE__);
+    free (log_to_string ());
+
+    /* Forking while holding the lock of the log stream must work.
+     * The child has a fresh lock.  */
+    alarm (10);
+    gpgrt_flockfile (gpgrt_log_get_stream ());
+    pid = fork ();
+    if (pid)
+      gpgrt_funlockfile (gpgrt_log_get_stream ());
+    alarm (0);
+    if (pid == (pid_t)(-1))
+      fail ("log_async test failed at line %d\n", __LINE__);
+    else if (!pid)
+      {
+        alarm (10);
+        log_info ("child record\n");
+        _exit (0);
+      }
+    else if (waitpid (pid, &status, 0) != pid
+             || !WIFEXITED (status) || WEXITSTATUS (status))
+      fail ("log_async test failed at line %d\n", __LINE__);
+    free (log_to_string ());
+  }
+#endif /*!HAVE_W32_SYSTEM*/
+
+  ec = gpgrt_log_set_async (0, 0);
+  if (ec)
+    fail ("gpgrt_log_set_async failed: %s\n", gpg_strerror (ec));
+
+  log_info ("sync again\n");
+  logbuf = log_to_string ();
+  if (strcmp (logbuf, "t-logging: sync again\n"))
+    fail ("log_async test failed at line %d\n", __LINE__);
+  free (logbuf);
+}
+
+
+/* Cookie write function counting the write calls.  Calls with a
+ * size of zero are flush requests and not counted.  */
+static gpgrt_ssize_t
+count_writer (void *cookie, const void *buffer, size_t size)
+{
+  int *nwrites = cookie;
+
+  (void)buffer;
+  if (size)
+    ++*nwrites;
+  return size;
+}
+
+
+/* Check that each record is written using only one write call.  Note
+ * that this closes the current log stream.  */
+static void
+check_single_write (void)
+{
+  gpgrt_cookie_io_functions_t io = { NULL };
+  estream_t fp;
+  int nwrites = 0;
+
+  io.func_write = count_writer;
+  fp = gpgrt_fopencookie (&nwrites, "w", io);
+  if (!fp)
+    die ("fopencookie failed at line %d\n", __LINE__);
+  gpgrt_log_set_sink (NULL, fp, -1);
+  gpgrt_log_set_prefix (NULL, (GPGRT_LOG_WITH_PREFIX|GPGRT_LOG_WITH_TIME
+                               |GPGRT_LOG_WITH_PID));
+
+  log_info ("file '%s' line %d: %s\n", "/foo/bar.txt", 20, "not found");
+  if (nwrites != 1)
+    fail ("single_write test failed at line %d (%d)\n", __LINE__, nwrites);
+  log_info ("no LF");
+  log_info ("next line\n");
+  if (nwrites != 3)
+    fail ("single_write test failed at line %d (%d)\n", __LINE__, nwrites);
+  log_debug_string ("foo\nbar", "%s", "extra:");
+  if (nwrites != 4)
+    fail ("single_write test failed at line %d (%d)\n", __LINE__, nwrites);
+
+  gpgrt_log_set_prefix (NULL, GPGRT_LOG_WITH_PREFIX);
+  gpgrt_log_set_sink (NULL, NULL, -1);
+}
+
+
+/* Read up to MAXLEN bytes from FD and append them to the buffer at
+ * R_DATA of allocated SIZE holding LEN bytes.  With MAXLEN given as
+ * 0 read until EOF.  */
+static void
+read_append (int fd, char **r_data, size_t *len, size_t *size, size_t maxlen)
+{
+  gpgrt_ssize_t n;
+  size_t want;
+
+  do
+    {
+      if (*len == *size)
+        {
+          *size += 65536;
+          *r_data = realloc (*r_data, *size);
+          if (!*r_data)
+            die ("malloc failed at line %d\n", __LINE__);
+        }
+      want = *size - *len;
+      if (maxlen && want > maxlen)
+        want = maxlen;
+      n = read (fd, *r_data + *len, want);
+      if (n > 0)
+        *len += n;
+    }
+  while (n > 0 && !maxlen);
+}
+
+
+/* Check that records logged while the log socket is not available
+ * are kept and delivered in order after the reconnect.  Note that
+ * this closes the current log stream.  */
+static void
+check_log_socket (void)
+{
+#ifndef HAVE_W32_SYSTEM
+  const char sockname[] = "t-logging.S";
+  struct sockaddr_un addr;
+  int lsock, fd;
+  char expected[256], fill[81];
+  char *data, *p, *nl;
+  size_t len, size;
+  int pid = (int)getpid ();
+  int i;
+
+  remove (sockname);
+  gpgrt_log_set_sink ("socket://t-logging.S", NULL, -1);
+  log_info ("retained %d\n", 1);
+  log_info ("retained %d\n", 2);
+
+  lsock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (lsock == -1)
+    die ("socket failed at line %d\n", __LINE__);
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, sockname);
+  if (bind (lsock, (struct sockaddr *)&addr, sizeof addr)
+      || listen (lsock, 5))
+    die ("bind/listen failed at line %d\n", __LINE__);
+
+  /* Wait for the first backoff period to pass.  */
+  sleep (2);
+  log_info ("live %d\n", 3);
+
+  fd = accept (lsock, NULL, NULL);
+  if (fd == -1)
+    die ("accept failed at line %d\n", __LINE__);
+
+  /* Overflow the socket and the retention buffer.  Records may be
+   * dropped but those received must be complete.  */
+  memset (fill, 'x', sizeof fill - 1);
+  fill[sizeof fill - 1] = 0;
+  size = len = 0;
+  data = NULL;
+  for (i=0; i < 20000; i++)
+    {
+      log_info ("fill %06d %s\n", i, fill);
+      /* Read a little from time to time so that records are sent
+       * only partly.  */
+      if (!(i % 1000) && i)
+        read_append (fd, &data, &len, &size, 3000);
+    }
+  gpgrt_log_set_sink (NULL, NULL, -1);
+  read_append (fd, &data, &len, &size, 0);
+
+  /* Logging to a socket forces the pid prefix.  */
+  snprintf (expected, sizeof expected,
+            "t-logging[%d]: retained 1\n"
+            "t-logging[%d]: retained 2\n"
+            "t-logging[%d]: live 3\n", pid, pid, pid);
+  if (len < strlen (expected) || memcmp (data, expected, strlen (expected)))
+    fail ("log_socket test failed at line %d\n", __LINE__);
+
+  p = data + strlen (expected);
+  snprintf (expected, sizeof expected, "t-logging[%d]: fill ", pid);
+  for (; p < data + len; p = nl + 1)
+    {
+      nl = memchr (p, '\n', data + len - p);
+      if (!nl)
+        break;  /* The last record may have been cut by the close.  */
+      if (nl - p != strlen (expected) + 7 + sizeof fill - 1
+          || strncmp (p, expected, strlen (expected))
+          || memcmp (nl - (sizeof fill - 1), fill, sizeof fill - 1))
+        {
+          fail ("log_socket test failed at line %d: '%.*s'\n",
+                __LINE__, (int)(nl - p), p);
+          break;
+        }
+    }
+  free (data);
+
+  close (fd);
+  close (lsock);
+  remove (sockname);
+#endif /*!HAVE_W32_SYSTEM*/
+}
+
+
+/* Check that each record is sent as one datagram.  Note that this
+ * closes the current log stream.  */
+static void
+check_log_dgram (void)
+{
+#ifndef HAVE_W32_SYSTEM
+  const char sockname[] = "t-logging.D";
+  struct sockaddr_un addr;
+  int sock;
+  char buffer[256], expected[256];
+  gpgrt_ssize_t n;
+  int i;
+  int pid = (int)getpid ();
+
+  remove (sockname);
+  sock = socket (AF_UNIX, SOCK_DGRAM, 0);
+  if (sock == -1)
+    die ("socket failed at line %d\n", __LINE__);
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, sockname);
+  if (bind (sock, (struct sockaddr *)&addr, sizeof addr))
+    die ("bind failed at line %d\n", __LINE__);
+
+  gpgrt_log_set_sink ("dgram://t-logging.D", NULL, -1);
+  log_info ("datagram %d\n", 1);
+  log_info ("datagram %d\n", 2);
+  gpgrt_log_set_sink (NULL, NULL, -1);
+
+  for (i=1; i <= 2; i++)
+    {
+      n = recv (sock, buffer, sizeof buffer - 1, 0);
+      if (n < 0)
+        die ("recv failed at line %d\n", __LINE__);
+      buffer[n] = 0;
+      snprintf (expected, sizeof expected,
+                "t-logging[%d]: datagram %d\n", pid, i);
+      if (strcmp (buffer, expected))
+        fail ("log_dgram test failed at line %d: '%s'\n", __LINE__, buffer);
+    }
+
+  close (sock);
+  remove (sockname);
+#endif /*!HAVE_W32_SYSTEM*/
+}
+
+
+/* Return the content of the file FNAME as a malloced string or NULL
+ * if it does not exist.  */
+static char *
+read_file (const char *fname)
+{
+  FILE *fp;
+  char *buf;
+  size_t n;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    return NULL;
+  buf = xmalloc (4096);
+  n = fread (buf, 1, 4095, fp);
+  buf[n] = 0;
+  fclose (fp);
+  return buf;
+}
+
+
+/* Check the rotation of log files.  Note that this closes the
+ * current log stream.  */
+static void
+check_log_rotate (void)
+{
+  const char fname[] = "t-logging.log";
+  FILE *fp;
+  char *buf;
+  int i;
+
+  remove ("t-logging.log");
+  remove ("t-logging.log.1");
+  remove ("t-logging.log.2");
+  remove ("t-logging.log.3");
+
+  /* Each record has 27 bytes; thus 3 fit into one file.  */
+  gpgrt_log_set_rotate (100, 0, 2);
+  gpgrt_log_set_sink (fname, NULL, -1);
+  for (i=1; i <= 11; i++)
+    log_info ("rotate record %d\n", i);
+  gpgrt_log_set_sink (NULL, NULL, -1);
+  gpgrt_log_set_rotate (0, 0, 0);
+
+  /* The first 3 records have been dropped with the third rotation.  */
+  buf = read_file ("t-logging.log.2");
+  if (!buf || strcmp (buf, ("t-logging: rotate record 4\n"
+                            "t-logging: rotate record 5\n"
+                            "t-logging: rotate record 6\n")))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log.1");
+  if (!buf || strcmp (buf, ("t-logging: rotate record 7\n"
+                            "t-logging: rotate record 8\n"
+                            "t-logging: rotate record 9\n")))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log");
+  if (!buf || strcmp (buf, ("t-logging: rotate record 10\n"
+                            "t-logging: rotate record 11\n")))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log.3");
+  if (buf)
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+
+  /* An existing file which is already larger than the limit is
+   * rotated with the first record.  */
+  remove ("t-logging.log.1");
+  remove ("t-logging.log.2");
+  fp = fopen (fname, "wb");
+  if (!fp)
+    die ("error creating '%s' at line %d\n", fname, __LINE__);
+  for (i=0; i < 50; i++)
+    fputs ("0123456789", fp);
+  fclose (fp);
+  gpgrt_log_set_rotate (100, 0, 2);
+  gpgrt_log_set_sink (fname, NULL, -1);
+  for (i=1; i <= 4; i++)
+    log_info ("rotate record %d\n", i);
+  gpgrt_log_set_sink (NULL, NULL, -1);
+  gpgrt_log_set_rotate (0, 0, 0);
+
+  buf = read_file ("t-logging.log.2");
+  if (!buf || strlen (buf) != 500)
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log.1");
+  if (!buf || strcmp (buf, ("t-logging: rotate record 1\n"
+                            "t-logging: rotate record 2\n"
+                            "t-logging: rotate record 3\n")))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log");
+  if (!buf || strcmp (buf, "t-logging: rotate record 4\n"))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+
+#ifndef HAVE_W32_SYSTEM
+  /* If the file can't be renamed it is used further without trying
+   * again for each record.  A directory as backup blocks the
+   * rename.  */
+  remove ("t-logging.log");
+  remove ("t-logging.log.1");
+  remove ("t-logging.log.2");
+  if (mkdir ("t-logging.log.1", 0700))
+    die ("error creating directory at line %d\n", __LINE__);
+  gpgrt_log_set_rotate (100, 0, 1);
+  gpgrt_log_set_sink (fname, NULL, -1);
+  for (i=1; i <= 4; i++)
+    log_info ("rotate record %d\n", i);
+  rmdir ("t-logging.log.1");
+  for (; i <= 6; i++)
+    log_info ("rotate record %d\n", i);
+  gpgrt_log_set_sink (NULL, NULL, -1);
+  gpgrt_log_set_rotate (0, 0, 0);
+
+  buf = read_file ("t-logging.log");
+  if (!buf || strcmp (buf, ("t-logging: rotate record 1\n"
+                            "t-logging: rotate record 2\n"
+                            "t-logging: rotate record 3\n"
+                            "t-logging: rotate record 4\n"
+                            "t-logging: rotate record 5\n"
+                            "t-logging: rotate record 6\n")))
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+  buf = read_file ("t-logging.log.1");
+  if (buf)
+    fail ("log_rotate test failed at line %d\n", __LINE__);
+  xfree (buf);
+#endif /*!HAVE_W32_SYSTEM*/
+
+  remove ("t-logging.log");
+  remove ("t-logging.log.1");
+  remove ("t-logging.log.2");
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -240,8 +1087,19 @@ main (int argc, char **argv)
   check_log_info ();
   gpgrt_log_set_prefix (NULL, GPGRT_LOG_WITH_PREFIX|GPGRT_LOG_WITH_PID);
   check_with_pid ();
+  check_with_time ();
   gpgrt_log_set_prefix (NULL, GPGRT_LOG_WITH_PREFIX);
   check_log_error ();
+  check_log_printhex ();
+  check_log_level ();
+  check_log_json ();
+  check_log_ratelimit ();
+  check_timer ();
+  check_log_async ();
+  check_single_write ();
+  check_log_socket ();
+  check_log_dgram ();
+  check_log_rotate ();
 
   /* FIXME: Add more tests.  */
 
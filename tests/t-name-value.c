@@ -38,6 +38,9 @@ static void test_whitespace (gpgrt_nvc_t pk);
 
 static int private_key_mode;
 static int section_mode;
+static unsigned int arena_flag;  /* Either 0 or GPGRT_NVC_ARENA.  */
+static int mem_mode;  /* Use gpgrt_nvc_parse_mem.  */
+static int binary_mode;  /* Convert to a binary image and back.  */
 
 static struct
 {
@@ -330,6 +333,37 @@ nvc_to_string (gpgrt_nvc_t pk)
 }
 
 
+/* Save PK as binary image, load it again, and return the new
+ * container.  PK is released.  If R_IMAGE is not NULL the image is
+ * stored there.  Terminates on error.  */
+static gpgrt_nvc_t
+nvc_binary_roundtrip (gpgrt_nvc_t pk, void **r_image, size_t *r_len)
+{
+  gpg_error_t err;
+  estream_t sink;
+  void *image;
+  size_t len;
+
+  sink = es_fopenmem (0, "w+");
+  gpgrt_assert (sink);
+  err = gpgrt_nvc_save_binary (pk, sink);
+  gpgrt_assert (!err);
+  gpgrt_nvc_release (pk);
+  gpgrt_assert (!es_fclose_snatch (sink, &image, &len));
+
+  err = gpgrt_nvc_load_binary (&pk, image, len, 0);
+  gpgrt_assert (!err && pk);
+  if (r_image)
+    {
+      *r_image = image;
+      *r_len = len;
+    }
+  else
+    es_free (image);
+  return pk;
+}
+
+
 static void dummy_free (void *p) { (void) p; }
 static void *dummy_realloc (void *p, size_t s) { (void) s; return p; }
 
@@ -343,6 +377,14 @@ run_tests (void)
   gpgrt_nvc_t pk;
   int i;
   int errlno;
+  unsigned int flags;
+
+  if (private_key_mode)
+    flags = GPGRT_NVC_PRIVKEY | arena_flag;
+  else if (section_mode)
+    flags = GPGRT_NVC_SECTION | arena_flag;
+  else
+    flags = arena_flag;
 
   for (i = 0; i < DIM (tests); i++)
     {
@@ -358,18 +400,19 @@ run_tests (void)
 			 0, dummy_realloc, dummy_free, "r");
       gpgrt_assert (source);
 
-      if (private_key_mode)
-        err = gpgrt_nvc_parse  (&pk, &errlno, source, GPGRT_NVC_PRIVKEY);
-      else if (section_mode)
-        err = gpgrt_nvc_parse  (&pk, &errlno, source, GPGRT_NVC_SECTION);
+      if (mem_mode)
+        err = gpgrt_nvc_parse_mem (&pk, &errlno, tests[i].value, len, flags);
       else
-        err = gpgrt_nvc_parse (&pk, &errlno, source, 0);
+        err = gpgrt_nvc_parse (&pk, &errlno, source, flags);
       if (err)
         show ("parser failed at input line %d: %s\n",
               errlno, gpg_strerror (err));
       gpgrt_assert (err == 0);
       gpgrt_assert (pk);
 
+      if (binary_mode)
+        pk = nvc_binary_roundtrip (pk, NULL, NULL);
+
       if (section_mode)
         buf = NULL;  /* nvc_to_string does not yet work.  */
       else
@@ -407,7 +450,8 @@ run_modification_tests (void)
 
   enter_test_function ();
 
-  pk = gpgrt_nvc_new (private_key_mode? GPGRT_NVC_PRIVKEY : 0);
+  pk = gpgrt_nvc_new ((private_key_mode? GPGRT_NVC_PRIVKEY : 0)
+                      | arena_flag);
   gpgrt_assert (pk);
 
   err = gpgrt_nvc_set (pk, "Foo:", "Bar");
@@ -544,7 +588,8 @@ run_modification_tests (void)
   xfree (buf);
   gpgrt_nvc_release (pk);
 
-  pk = gpgrt_nvc_new (private_key_mode? GPGRT_NVC_PRIVKEY : 0);
+  pk = gpgrt_nvc_new ((private_key_mode? GPGRT_NVC_PRIVKEY : 0)
+                      | arena_flag);
   gpgrt_assert (pk);
 
   err = gpgrt_nvc_set (pk, "Key:", "(hello world)");
@@ -559,6 +604,397 @@ run_modification_tests (void)
 
 
 
+/*
+ * Run tests on a container large enough to use the hash index.
+ */
+static void
+run_index_tests (void)
+{
+  gpg_error_t err;
+  gpgrt_nvc_t pk;
+  gpgrt_nve_t e;
+  estream_t source;
+  char *text, *p;
+  char name[20], value[20];
+  const char *s;
+  int i, n;
+
+  enter_test_function ();
+
+  /* Create 40 names with the entries of "Dup" spread over the file.  */
+  text = xmalloc (40 * 40);
+  for (p = text, i = 0; i < 40; i++)
+    {
+      p += sprintf (p, "Name%d: v%d\n", i, i);
+      if (!(i % 5))
+        p += sprintf (p, "Dup: d%d\n", i);
+    }
+  source = es_fopenmem_init (0, "r", text, strlen (text));
+  gpgrt_assert (source);
+  err = gpgrt_nvc_parse (&pk, NULL, source, arena_flag);
+  gpgrt_assert (!err);
+  es_fclose (source);
+  xfree (text);
+  gpgrt_assert (!gpgrt_nvc_get_flag (pk, GPGRT_NVC_ARENA, 0) == !arena_flag);
+
+  for (i = 0; i < 40; i++)
+    {
+      snprintf (name, sizeof name, (i & 1)? "name%d:" : "NAME%d", i);
+      snprintf (value, sizeof value, "v%d", i);
+      s = gpgrt_nvc_get_string (pk, name);
+      gpgrt_assert (s && !strcmp (s, value));
+    }
+  gpgrt_assert (!gpgrt_nvc_lookup (pk, "Name40"));
+  gpgrt_assert (!gpgrt_nvc_lookup (pk, "Name"));
+
+  /* The entries of a name are returned in file order.  */
+  n = 0;
+  for (e = gpgrt_nvc_lookup (pk, "dup"); e; e = gpgrt_nve_next (e, "Dup:"))
+    {
+      snprintf (value, sizeof value, "d%d", n);
+      gpgrt_assert (!strcmp (gpgrt_nve_value (e), value));
+      n += 5;
+    }
+  gpgrt_assert (n == 40);
+
+  /* A new entry is added after the first block of its name; thus
+   * it shows up as the second one.  */
+  err = gpgrt_nvc_add (pk, "Dup:", "new");
+  gpgrt_assert (!err);
+  e = gpgrt_nvc_lookup (pk, "Dup");
+  gpgrt_assert (e && !strcmp (gpgrt_nve_value (e), "d0"));
+  e = gpgrt_nve_next (e, "Dup");
+  gpgrt_assert (e && !strcmp (gpgrt_nve_value (e), "new"));
+  gpgrt_assert (gpgrt_nve_next (e, NULL) == gpgrt_nvc_lookup (pk, "Name1"));
+  e = gpgrt_nve_next (e, "Dup");
+  gpgrt_assert (e && !strcmp (gpgrt_nve_value (e), "d5"));
+
+  /* Delete the first entry of a name and then all entries.  */
+  gpgrt_nvc_delete (pk, gpgrt_nvc_lookup (pk, "Dup"), NULL);
+  e = gpgrt_nvc_lookup (pk, "Dup");
+  gpgrt_assert (e && !strcmp (gpgrt_nve_value (e), "new"));
+  gpgrt_nvc_delete (pk, NULL, "Dup");
+  gpgrt_assert (!gpgrt_nvc_lookup (pk, "Dup"));
+
+  /* Deleting an entry in the middle keeps the others.  */
+  gpgrt_nvc_delete (pk, gpgrt_nvc_lookup (pk, "Name20"), NULL);
+  gpgrt_assert (!gpgrt_nvc_lookup (pk, "Name20"));
+  gpgrt_assert (gpgrt_nvc_lookup (pk, "Name19"));
+  gpgrt_assert (gpgrt_nvc_lookup (pk, "Name21"));
+
+  /* Many more names require a larger index.  */
+  for (i = 40; i < 200; i++)
+    {
+      snprintf (name, sizeof name, "Name%d", i);
+      snprintf (value, sizeof value, "v%d", i);
+      err = gpgrt_nvc_set (pk, name, value);
+      gpgrt_assert (!err);
+    }
+  for (i = 0; i < 200; i++)
+    {
+      snprintf (name, sizeof name, "Name%d", i);
+      snprintf (value, sizeof value, "v%d", i);
+      s = gpgrt_nvc_get_string (pk, name);
+      if (i == 20)
+        gpgrt_assert (!s);
+      else
+        gpgrt_assert (s && !strcmp (s, value));
+    }
+
+  gpgrt_nvc_release (pk);
+
+  leave_test_function ();
+}
+
+
+/*
+ * Run extra tests for gpgrt_nvc_parse_mem.
+ */
+static void
+run_mem_tests (void)
+{
+  static const char doc[] =
+    "# No linefeed at the end and a simple line with trailing spaces\n"
+    "A: a  \n"
+    "B:b\n"
+    "C: c\n"
+    "D: d1\n"
+    " d2\n"
+    "E: e";
+  gpg_error_t err;
+  gpgrt_nvc_t pk;
+  int errlno;
+  char *buf;
+
+  enter_test_function ();
+
+  err = gpgrt_nvc_parse_mem (&pk, &errlno, doc, strlen (doc), 0);
+  gpgrt_assert (!err);
+  gpgrt_assert (errlno == 7);
+  gpgrt_assert (gpgrt_nvc_get_flag (pk, GPGRT_NVC_ARENA, 0));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "A"), "a"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "B"), "b"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "C"), "c"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "D"), "d1d2"));
+  gpgrt_assert (!strcmp (gpgrt_nve_name (gpgrt_nvc_lookup (pk, "E")), "E:"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "E"), "e"));
+  buf = nvc_to_string (pk);
+  gpgrt_assert (!strcmp (buf, doc));
+  xfree (buf);
+
+  /* Updating a value taken from the buffer.  */
+  err = gpgrt_nvc_set (pk, "C", "new c");
+  gpgrt_assert (!err);
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "C"), "new c"));
+  buf = nvc_to_string (pk);
+  gpgrt_assert (strstr (buf, "\nC: new c\nD: d1\n d2\n"));
+  xfree (buf);
+  gpgrt_nvc_release (pk);
+
+  /* An empty buffer and a syntax error.  */
+  err = gpgrt_nvc_parse_mem (&pk, &errlno, "", 0, 0);
+  gpgrt_assert (!err && pk && !gpgrt_nvc_lookup (pk, NULL));
+  gpgrt_nvc_release (pk);
+  err = gpgrt_nvc_parse_mem (&pk, &errlno, "A: a\nfoo\n", 9, 0);
+  gpgrt_assert (err == GPG_ERR_INV_VALUE && !pk && errlno == 2);
+
+  leave_test_function ();
+}
+
+
+/*
+ * Run extra tests for the binary images.
+ */
+static void
+run_binary_tests (void)
+{
+  gpg_error_t err;
+  gpgrt_nvc_t pk;
+  void *image;
+  size_t len, n;
+  char *buf, *buf2;
+
+  enter_test_function ();
+
+  pk = gpgrt_nvc_new (GPGRT_NVC_PRIVKEY);
+  gpgrt_assert (pk);
+  err = gpgrt_nvc_add (pk, "Key:", "(private-key (dummy))");
+  gpgrt_assert (!err);
+  err = gpgrt_nvc_add (pk, "Comment:", "A comment\nwith two lines");
+  gpgrt_assert (!err);
+  buf = nvc_to_string (pk);
+
+  pk = nvc_binary_roundtrip (pk, &image, &len);
+  gpgrt_assert (gpgrt_nvc_get_flag (pk, GPGRT_NVC_PRIVKEY, 0));
+  gpgrt_assert (!gpgrt_nvc_get_flag (pk, GPGRT_NVC_MODIFIED, 0));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "Comment"),
+                         "A comment\nwith two lines"));
+  err = gpgrt_nvc_add (pk, "Key:", "(another)");
+  gpgrt_assert (err == GPG_ERR_INV_NAME);
+  buf2 = nvc_to_string (pk);
+  gpgrt_assert (!strcmp (buf, buf2));
+  xfree (buf);
+  xfree (buf2);
+  gpgrt_nvc_release (pk);
+
+  /* A truncated or modified image is detected.  */
+  for (n = 0; n < len; n++)
+    {
+      err = gpgrt_nvc_load_binary (&pk, image, n, 0);
+      gpgrt_assert (err && !pk);
+    }
+  ((char *)image)[1] = 'X';
+  err = gpgrt_nvc_load_binary (&pk, image, len, 0);
+  gpgrt_assert (err == GPG_ERR_INV_OBJ && !pk);
+  es_free (image);
+
+  leave_test_function ();
+}
+
+
+/*
+ * Run tests for gpgrt_nvc_update_file.
+ */
+static void
+run_update_tests (void)
+{
+  static const char doc[] =
+    "# A comment\n"
+    "Name: Value\n"
+    "Long: A value with\n"
+    "   continuation\n"
+    "[sec1]\n"
+    "A: a\n"
+    "[sec2] # Comment\n"
+    "B: b\n"
+    "[sec1]\n"
+    "C: c\n";
+  static const char expected[] =
+    "# A comment\n"
+    "Name: Value\n"
+    "Long: A value with\n"
+    "   continuation\n"
+    "New: new\n"
+    "[sec1]\n"
+    "A: a\n"
+    "[sec2]\n"
+    "B: changed\n"
+    "[sec1]\n"
+    "C: c\n";
+  const char fname[] = "t-name-value-upd.tmp";
+  gpg_error_t err;
+  gpgrt_nvc_t pk;
+  estream_t fp;
+  char buf[512];
+  size_t n;
+
+  enter_test_function ();
+
+  err = gpgrt_nvc_parse_mem (&pk, NULL, doc, strlen (doc), GPGRT_NVC_SECTION);
+  gpgrt_assert (!err);
+  gpgrt_assert (!gpgrt_nvc_get_flag (pk, GPGRT_NVC_MODIFIED, 0));
+
+  /* Nothing is written if the container has not been modified.  */
+  remove (fname);
+  err = gpgrt_nvc_update_file (pk, fname);
+  gpgrt_assert (!err);
+  gpgrt_assert (!(fp = es_fopen (fname, "r")));
+
+  err = gpgrt_nvc_set (pk, "sec2:B", "changed");
+  gpgrt_assert (!err);
+  err = gpgrt_nvc_add (pk, "New:", "new");
+  gpgrt_assert (!err);
+  err = gpgrt_nvc_update_file (pk, fname);
+  gpgrt_assert (!err);
+  gpgrt_assert (!gpgrt_nvc_get_flag (pk, GPGRT_NVC_MODIFIED, 0));
+  gpgrt_nvc_release (pk);
+
+  fp = es_fopen (fname, "r");
+  gpgrt_assert (fp);
+  gpgrt_assert (!es_read (fp, buf, sizeof buf - 1, &n));
+  buf[n] = 0;
+  es_fclose (fp);
+  if (strcmp (buf, expected))
+    fail ("update_file wrote:\n%s", buf);
+
+  /* The written file gives the same container.  Note that
+   * gpgrt_nvc_parse marks the container as modified.  */
+  fp = es_fopen (fname, "r");
+  gpgrt_assert (fp);
+  err = gpgrt_nvc_parse (&pk, NULL, fp, GPGRT_NVC_SECTION);
+  gpgrt_assert (!err);
+  es_fclose (fp);
+  gpgrt_assert (gpgrt_nvc_get_flag (pk, GPGRT_NVC_MODIFIED, 0));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "Long"),
+                         "A value with  continuation"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "sec1:C"), "c"));
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "sec2:B"), "changed"));
+
+  /* A stale temporary file from an earlier crash does not block
+   * further updates.  */
+  fp = es_fopen ("t-name-value-upd.tmp.tmp", "w");
+  gpgrt_assert (fp);
+  es_fclose (fp);
+  err = gpgrt_nvc_set (pk, "sec2:B", "again");
+  gpgrt_assert (!err);
+  err = gpgrt_nvc_update_file (pk, fname);
+  gpgrt_assert (!err);
+  gpgrt_assert (!gpgrt_nvc_get_flag (pk, GPGRT_NVC_MODIFIED, 0));
+  remove ("t-name-value-upd.tmp.tmp");
+  gpgrt_nvc_release (pk);
+
+  fp = es_fopen (fname, "r");
+  gpgrt_assert (fp);
+  err = gpgrt_nvc_parse (&pk, NULL, fp, GPGRT_NVC_SECTION);
+  gpgrt_assert (!err);
+  es_fclose (fp);
+  gpgrt_assert (!strcmp (gpgrt_nvc_get_string (pk, "sec2:B"), "again"));
+  gpgrt_nvc_release (pk);
+
+  remove (fname);
+  leave_test_function ();
+}
+
+
+/*
+ * Run tests for gpgrt_nvc_parse_files.
+ */
+static void
+run_files_tests (void)
+{
+#define NFILES 20
+  gpg_err_code_t err;
+  gpgrt_nvc_t results[NFILES];
+  gpg_err_code_t errors[NFILES];
+  char *fnames[NFILES];
+  char value[20];
+  estream_t fp;
+  const char *s;
+  int i, j, nthreads;
+
+  enter_test_function ();
+
+  for (i = 0; i < NFILES; i++)
+    {
+      fnames[i] = xmalloc (40);
+      snprintf (fnames[i], 40, "t-name-value-%d.tmp", i);
+      if (i == 5)
+        continue;  /* This one does not exist.  */
+      fp = es_fopen (fnames[i], "w");
+      gpgrt_assert (fp);
+      if (i == 7)
+        es_fprintf (fp, "# Not a valid file\nFoo\n");
+      else
+        es_fprintf (fp, "# File %d\nIndex: %d\nMore: a\n b\n", i, i);
+      gpgrt_assert (!es_fclose (fp));
+    }
+
+  for (nthreads = 0; nthreads < 3; nthreads++)
+    {
+      err = gpgrt_nvc_parse_files (results, errors,
+                                   (const char * const *)fnames, NFILES,
+                                   arena_flag, nthreads);
+      gpgrt_assert (err == GPG_ERR_ENOENT);
+      for (i = 0; i < NFILES; i++)
+        {
+          if (i == 5)
+            gpgrt_assert (errors[i] == GPG_ERR_ENOENT && !results[i]);
+          else if (i == 7)
+            gpgrt_assert (errors[i] == GPG_ERR_INV_VALUE && !results[i]);
+          else
+            {
+              gpgrt_assert (!errors[i] && results[i]);
+              snprintf (value, sizeof value, "%d", i);
+              s = gpgrt_nvc_get_string (results[i], "Index");
+              gpgrt_assert (s && !strcmp (s, value));
+              s = gpgrt_nvc_get_string (results[i], "More");
+              gpgrt_assert (s && !strcmp (s, "ab"));
+            }
+          gpgrt_nvc_release (results[i]);
+        }
+    }
+
+  /* The first error is returned.  */
+  err = gpgrt_nvc_parse_files (results, errors,
+                               (const char * const *)fnames + 6, 4, 0, 4);
+  gpgrt_assert (err == GPG_ERR_INV_VALUE);
+  for (j = 0; j < 4; j++)
+    gpgrt_nvc_release (results[j]);
+
+  err = gpgrt_nvc_parse_files (NULL, NULL, NULL, 0, 0, 0);
+  gpgrt_assert (!err);
+
+  for (i = 0; i < NFILES; i++)
+    {
+      remove (fnames[i]);
+      xfree (fnames[i]);
+    }
+
+  leave_test_function ();
+#undef NFILES
+}
+
+
 static void
 parse (const char *fname)
 {
@@ -680,6 +1116,9 @@ main (int argc, char **argv)
 
       run_tests ();
       run_modification_tests ();
+      run_index_tests ();
+      run_files_tests ();
+      run_update_tests ();
 
       show ("again in private key mode\n");
       /* Now again in rivate key mode */
@@ -692,6 +1131,42 @@ main (int argc, char **argv)
       section_mode = 1;
       run_tests ();
 
+      show ("again in arena mode\n");
+      arena_flag = GPGRT_NVC_ARENA;
+      section_mode = 0;
+      run_tests ();
+      run_modification_tests ();
+      run_index_tests ();
+      private_key_mode = 1;
+      run_tests ();
+      private_key_mode = 0;
+      section_mode = 1;
+      run_tests ();
+
+      show ("again with parsing from memory\n");
+      arena_flag = 0;
+      mem_mode = 1;
+      section_mode = 0;
+      run_tests ();
+      run_mem_tests ();
+      private_key_mode = 1;
+      run_tests ();
+      private_key_mode = 0;
+      section_mode = 1;
+      run_tests ();
+
+      show ("again with binary images\n");
+      mem_mode = 0;
+      binary_mode = 1;
+      section_mode = 0;
+      run_tests ();
+      run_binary_tests ();
+      private_key_mode = 1;
+      run_tests ();
+      private_key_mode = 0;
+      section_mode = 1;
+      run_tests ();
+
       show ("testing name-value functions finished\n");
     }
   else if (command == CMD_PARSE)
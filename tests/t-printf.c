@@ -217,6 +217,12 @@ run_tests (void)
   one_test_1 ("%-d", -17);
   one_test_1 ("%-4d", -17);
   one_test_1 ("%-40d", -17);
+  /* Sizes around the internal stack buffer of asprintf.  */
+  one_test_1 ("%254d", 17);
+  one_test_1 ("%255d", 17);
+  one_test_1 ("%256d", 17);
+  one_test_1 ("%1000d", 17);
+  one_test_2 ("%250d%20d", 17, 42);
 
   one_test_1 ("%+4d", 17);
   one_test_1 ("%+4d", -17);
@@ -585,6 +591,39 @@ check_fprintf_sf (void)
   gpgrt_fclose (stream);
 }
 
+/* Check output which does not fit into the staging buffer used by
+ * the formatter.  */
+static void
+check_fprintf_staging (void)
+{
+  gpgrt_stream_t stream;
+  char expect[800];
+  char *result;
+  int n1, n2, rc;
+
+  stream = gpgrt_fopenmem (0, "w+b");
+  if (!stream)
+    die ("fopenmem failed at line %d\n", __LINE__);
+
+  rc = gpgrt_fprintf (stream, "a=%500s|%n%*d|%s%n|%-90s|",
+                      "x", &n1, 100, 42, "tail", &n2, "y");
+  snprintf (expect, sizeof expect, "a=%500s|%*d|%s|%-90s|",
+            "x", 100, 42, "tail", "y");
+  result = stream_to_string (stream);
+  if (strcmp (result, expect))
+    {
+      show ("expect: '%s'\n", expect);
+      show ("result: '%s'\n", result);
+      fail ("fprintf staging failed at %d\n", __LINE__);
+    }
+  if (rc != strlen (expect) || n1 != 503 || n2 != 608)
+    fail ("fprintf staging failed at %d (rc=%d n1=%d n2=%d)\n",
+          __LINE__, rc, n1, n2);
+  free (result);
+  gpgrt_fclose (stream);
+}
+
+
 static void
 check_fwrite (void)
 {
@@ -656,6 +695,7 @@ main (int argc, char **argv)
   check_snprintf ();
   check_large_float ();
   check_fprintf_sf ();
+  check_fprintf_staging ();
   check_fwrite ();
 
 #ifdef __GLIBC__
@@ -99,7 +99,152 @@ check_strlist_rev (void)
 
 
 static void
-check_tokenize_to_strlist (void)
+check_strlist_append (void)
+{
+  gpgrt_strlist_t s = NULL;
+  gpgrt_strlist_t tail = NULL;
+  gpgrt_strlist_t sl;
+  char buf[20];
+  int i;
+
+  enter_test_function ();
+
+  for (i = 0; i < 1000; i++)
+    {
+      snprintf (buf, sizeof buf, "%d", i);
+      sl = gpgrt_strlist_append (&s, &tail, buf, (i & 1)? GPGRT_STRLIST_WIPE:0);
+      if (!sl)
+        fail ("failed at %d: %s", __LINE__, strerror (errno));
+      if (sl != tail || sl->next)
+        fail ("failed at %d", __LINE__);
+    }
+  if (gpgrt_strlist_count (s) != 1000)
+    fail ("failed at %d", __LINE__);
+  for (i = 0, sl = s; sl; sl = sl->next, i++)
+    {
+      snprintf (buf, sizeof buf, "%d", i);
+      if (strcmp (sl->d, buf))
+        fail ("failed at %d", __LINE__);
+    }
+  if (gpgrt_strlist_last (s) != tail)
+    fail ("failed at %d", __LINE__);
+
+  /* A NULL tail is also allowed for a non-empty list.  */
+  tail = NULL;
+  sl = gpgrt_strlist_append (&s, &tail, NULL, 0);
+  if (!sl || sl != tail || gpgrt_strlist_last (s) != sl || *sl->d)
+    fail ("failed at %d", __LINE__);
+
+  /* As is a NULL TAILP.  */
+  sl = gpgrt_strlist_append (&s, NULL, "x", 0);
+  if (!sl || gpgrt_strlist_last (s) != sl || strcmp (sl->d, "x"))
+    fail ("failed at %d", __LINE__);
+
+  gpgrt_strlist_free (s);
+  leave_test_function ();
+}
+
+
+static void
+check_strlist_copy (void)
+{
+  gpgrt_strlist_t s = NULL;
+  gpgrt_strlist_t copy, sl, sl2;
+
+  enter_test_function ();
+
+  gpgrt_strlist_add (&s, "1", 0);
+  gpgrt_strlist_add (&s, "2", GPGRT_STRLIST_WIPE);
+  gpgrt_strlist_add (&s, "3", 0);
+
+  copy = gpgrt_strlist_copy (s);
+  if (!copy || gpgrt_strlist_count (copy) != 3)
+    fail ("failed at %d", __LINE__);
+  for (sl = s, sl2 = copy; sl && sl2; sl = sl->next, sl2 = sl2->next)
+    if (sl == sl2 || strcmp (sl->d, sl2->d) || sl->flags != sl2->flags)
+      fail ("failed at %d", __LINE__);
+
+  gpgrt_strlist_free (s);
+  gpgrt_strlist_free (copy);
+  leave_test_function ();
+}
+
+
+static void
+check_strset (void)
+{
+  gpgrt_strset_t set;
+  gpgrt_strlist_t list = NULL;
+  gpgrt_strlist_t sl;
+  char buf[20];
+  int i;
+
+  enter_test_function ();
+
+  set = gpgrt_strset_new (0);
+  if (!set)
+    fail ("failed at %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_strset_contains (set, "a") || gpgrt_strset_count (set))
+    fail ("failed at %d", __LINE__);
+
+  /* Enough strings to grow the table a few times.  */
+  for (i = 0; i < 500; i++)
+    {
+      snprintf (buf, sizeof buf, "item-%d", i);
+      if (gpgrt_strset_add (set, buf))
+        fail ("failed at %d", __LINE__);
+    }
+  if (gpgrt_strset_add (set, "item-42") || gpgrt_strset_count (set) != 500)
+    fail ("failed at %d", __LINE__);
+  for (i = 0; i < 600; i++)
+    {
+      snprintf (buf, sizeof buf, "item-%d", i);
+      if (!gpgrt_strset_contains (set, buf) != (i >= 500))
+        fail ("failed at %d", __LINE__);
+    }
+  if (gpgrt_strset_contains (set, "ITEM-1") || gpgrt_strset_contains (set, ""))
+    fail ("failed at %d", __LINE__);
+
+  /* Conversion to a list keeps the insertion order.  */
+  gpgrt_strlist_add (&list, "first", 0);
+  if (gpgrt_strset_to_strlist (set, &list))
+    fail ("failed at %d", __LINE__);
+  if (gpgrt_strlist_count (list) != 501 || strcmp (list->d, "first"))
+    fail ("failed at %d", __LINE__);
+  for (i = 0, sl = list->next; sl; sl = sl->next, i++)
+    {
+      snprintf (buf, sizeof buf, "item-%d", i);
+      if (strcmp (sl->d, buf))
+        fail ("failed at %d", __LINE__);
+    }
+  gpgrt_strset_release (set);
+
+  /* Case-insensitive mode and conversion from a list.  */
+  set = gpgrt_strset_new (GPGRT_STRSET_ICASE | GPGRT_STRSET_WIPE);
+  if (!set)
+    fail ("failed at %d: %s", __LINE__, strerror (errno));
+  if (gpgrt_strset_add (set, "Foo") || gpgrt_strset_add (set, "FOO"))
+    fail ("failed at %d", __LINE__);
+  if (gpgrt_strset_count (set) != 1
+      || !gpgrt_strset_contains (set, "foo")
+      || gpgrt_strset_contains (set, "fo"))
+    fail ("failed at %d", __LINE__);
+  if (gpgrt_strset_add_strlist (set, list))
+    fail ("failed at %d", __LINE__);
+  if (gpgrt_strset_count (set) != 502
+      || !gpgrt_strset_contains (set, "ITEM-499")
+      || !gpgrt_strset_contains (set, "First"))
+    fail ("failed at %d", __LINE__);
+  gpgrt_strlist_free (list);
+  gpgrt_strset_release (set);
+
+  gpgrt_strset_release (NULL);
+  leave_test_function ();
+}
+
+
+static void
+check_tokenize_to_strlist (unsigned int flags)
 {
   struct {
     const char *s;
@@ -221,7 +366,7 @@ check_tokenize_to_strlist (void)
           gpgrt_strlist_add (&list, prefixes[i], GPGRT_STRLIST_APPEND);
 
         newitems = gpgrt_strlist_tokenize (&list, tv[tidx].s, tv[tidx].delim,
-                                           0);
+                                           flags);
         if (!newitems)
           {
             if (gpg_err_code_from_syserror () == GPG_ERR_ENOENT
@@ -293,6 +438,52 @@ check_tokenize_to_strlist (void)
 }
 
 
+/* Check that the items of a slab can be handled one by one.  */
+static void
+check_tokenize_slab (void)
+{
+  gpgrt_strlist_t list = NULL;
+  gpgrt_strlist_t sl, copy;
+  char *p;
+
+  enter_test_function ();
+
+  gpgrt_strlist_add (&list, "first", GPGRT_STRLIST_APPEND);
+  sl = gpgrt_strlist_tokenize (&list, " a, bb ,, ccc,dddd ", ",",
+                               GPGRT_STRLIST_SLAB|GPGRT_STRLIST_WIPE);
+  if (!sl || strcmp (sl->d, "a") || gpgrt_strlist_count (list) != 5)
+    fail ("failed at %d", __LINE__);
+
+  /* Pop the plain item and the first item of the slab.  */
+  p = gpgrt_strlist_pop (&list);
+  if (!p || strcmp (p, "first"))
+    fail ("failed at %d", __LINE__);
+  gpgrt_free (p);
+  p = gpgrt_strlist_pop (&list);
+  if (!p || strcmp (p, "a"))
+    fail ("failed at %d", __LINE__);
+  gpgrt_free (p);
+
+  /* Copies are independent of the slab.  */
+  copy = gpgrt_strlist_copy (list);
+  if (!copy || strcmp (copy->d, "bb") || gpgrt_strlist_count (copy) != 3)
+    fail ("failed at %d", __LINE__);
+
+  /* Free the slab items in reverse order.  */
+  gpgrt_strlist_rev (&list);
+  if (!list || strcmp (list->d, "dddd")
+      || !list->next || strcmp (list->next->d, "ccc"))
+    fail ("failed at %d", __LINE__);
+  gpgrt_strlist_free (list);
+
+  if (!copy || strcmp (copy->d, "bb"))
+    fail ("failed at %d", __LINE__);
+  gpgrt_strlist_free (copy);
+
+  leave_test_function ();
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -320,7 +511,13 @@ main (int argc, char **argv)
   show ("testing strlist functions\n");
 
   check_strlist_rev ();
-  check_tokenize_to_strlist ();
+  check_strlist_append ();
+  check_strlist_copy ();
+  check_strset ();
+  check_tokenize_to_strlist (0);
+  check_tokenize_to_strlist (GPGRT_STRLIST_SLAB);
+  check_tokenize_to_strlist (GPGRT_STRLIST_SLAB|GPGRT_STRLIST_WIPE);
+  check_tokenize_slab ();
 
   show ("testing strlist functions finished\n");
   return !!errorcount;